@@ -25,6 +25,7 @@ typedef void* ConstelTrainerHandle;
 typedef void* ConstelControllerHandle;
 typedef void* ConstellationCArrayHandle;
 typedef void* ConstellationCArrayDataPtrType;
+typedef void* ConstellationPushPullHandle;
 
 class CtypesInfoBuffer {
  public:
@@ -116,6 +117,98 @@ int ConstellationTrainerPushPull(ConstelTrainerHandle handle,
                                  ConstellationCArrayHandle* values,
                                  ConstellationCArrayHandle* outs);
 
+/** @brief push and pull the data with a priority per key, keys with a higher
+ * priority are reduced and sent first
+ * @param handle - the handle of the trainer
+ * @param key_num - the number of keys to push and pull
+ * @param keys_in - the keys to push
+ * @param key_num_out - the number of keys to pull
+ * @param keys_out - the keys to pull
+ * @param values - the values to push
+ * @param outs - the values to pull
+ * @param priorities - the priority of each key in keys_in
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationTrainerPushPullWithPriority(ConstelTrainerHandle handle,
+                                             uint32_t key_num,
+                                             const int* keys_in,
+                                             uint32_t key_num_out,
+                                             const int* keys_out,
+                                             ConstellationCArrayHandle* values,
+                                             ConstellationCArrayHandle* outs,
+                                             const int* priorities);
+
+/** @brief start a push and pull without waiting for it
+ * @param handle - the handle of the trainer
+ * @param key_num - the number of keys to push and pull
+ * @param keys_in - the keys to push
+ * @param key_num_out - the number of keys to pull
+ * @param keys_out - the keys to pull
+ * @param values - the values to push, must stay alive until it is done
+ * @param outs - the values to pull, must stay alive until it is done
+ * @param priorities - the priority of each key in keys_in, or NULL
+ * @param out - the handle to wait on, free it with
+ * ConstellationPushPullHandleFree
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationTrainerPushPullAsync(ConstelTrainerHandle handle,
+                                      uint32_t key_num,
+                                      const int* keys_in,
+                                      uint32_t key_num_out,
+                                      const int* keys_out,
+                                      ConstellationCArrayHandle* values,
+                                      ConstellationCArrayHandle* outs,
+                                      const int* priorities,
+                                      ConstellationPushPullHandle* out);
+
+/** @brief push and pull row-sparse values, e.g. embedding gradients: only
+ * the pushed rows travel and the pulled value is every row any trainer
+ * pushed, summed and sorted by row id
+ * @param handle - the handle of the trainer
+ * @param key_num - the number of keys to push and pull
+ * @param keys - the keys to push and pull
+ * @param num_rows - the number of rows pushed for each key
+ * @param row_ids - the ids of the pushed rows, of one key after another
+ * @param values - the pushed rows of each key
+ * @param max_rows_out - the number of rows row_ids_out and outs have room
+ * for, per key
+ * @param num_rows_out - set to the number of rows pulled for each key
+ * @param row_ids_out - the ids of the pulled rows, each key starts at the
+ * sum of max_rows_out of the keys before it
+ * @param outs - the pulled rows of each key
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationTrainerPushPullRowSparse(ConstelTrainerHandle handle,
+                                          uint32_t key_num,
+                                          const int* keys,
+                                          const uint64_t* num_rows,
+                                          const uint64_t* row_ids,
+                                          ConstellationCArrayHandle* values,
+                                          const uint64_t* max_rows_out,
+                                          uint64_t* num_rows_out,
+                                          uint64_t* row_ids_out,
+                                          ConstellationCArrayHandle* outs);
+
+/** @brief block until the push and pull is done
+ * @param handle - the handle returned by ConstellationTrainerPushPullAsync
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationPushPullHandleWait(ConstellationPushPullHandle handle);
+
+/** @brief check whether the push and pull is done
+ * @param handle - the handle returned by ConstellationTrainerPushPullAsync
+ * @param done - set to 1 if done, 0 otherwise
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationPushPullHandlePoll(ConstellationPushPullHandle handle,
+                                    int* done);
+
+/** @brief free the handle, the push and pull itself is not cancelled
+ * @param handle - the handle returned by ConstellationTrainerPushPullAsync
+ * @return 0 - success, -1 - failure
+ */
+int ConstellationPushPullHandleFree(ConstellationPushPullHandle handle);
+
 /** @brief init the trainer
  * @param handle - the handle of the trainer
  * @param key_num - the number of keys to init
@@ -37,12 +37,32 @@ using AdjacencyList = std::unordered_map<int, std::vector<int>>;
 
 template <typename T>
 using AdjacencyListT = std::unordered_map<int, std::vector<T>>;
+/** @brief The place of a node in an additional spanning tree
+ * - parent: the parent in the tree, 0 on its root
+ * - children: the children in the tree
+ */
+struct TreeLinks {
+  DEFAULT_SPECIAL_MEMBERS(TreeLinks);
+
+  int parent = 0;
+  std::vector<int> children;
+};
+
 /** @brief Node transport topology.
  * including member parent and children
  * @param `type`: the `type` of this node, `kRoot` - root node, `kLeaf` - leaf
  * node, `kInner` - inner node and `kUnset` - unset
  * - parent: the parent of this node, only valid for inner and leaf nodes
  * - children: the children of this node
+ * - scatter_group: set on the root and those of its children, all pairwise
+ * overlay neighbours, if they reduce-scatter and all-gather large keys among
+ * themselves instead of reducing them on the root, empty otherwise. The
+ * other children push to the root as usual. The root comes first, the order
+ * fixes the segment each member reduces.
+ * - extra_trees: the place of this node in the spanning trees besides this
+ * one, keys are striped over all of them
+ * - tree_weights: the share of the keys of each tree, this one first. Empty
+ * if there is only one tree.
  */
 struct NodeTransTopo {
   enum class Type {
@@ -120,6 +140,9 @@ struct NodeTransTopo {
   std::vector<int> children_;
   size_t num_trainers = 0;
   size_t rank = 0;
+  std::vector<int> scatter_group;
+  std::vector<TreeLinks> extra_trees;
+  std::vector<float> tree_weights;
 };
 
 /** @brief Global transport topology.
@@ -279,10 +302,27 @@ struct ScaleClock {
     uint32_t timestamp;
     GlobalTransTopo transtopo;
     ModelSycnConf model_sync_conf;
+    /**
+     * \brief how the model of this tick migrates, one of kMigrate*. With a
+     * snapshot the model moves before the joining node enters the tree and is
+     * caught up when it does: the senders keep what they send at their
+     * kMigrateSnapshot tick and send the change since then at their
+     * kMigrateCatchUp tick, the joining node's tick is kMigrateCatchUp and it
+     * expects the model twice
+     */
+    int migrate_phase = kMigrateOnce;
+
+    /** \brief the values are sent at this tick */
+    static constexpr int kMigrateOnce = 0;
+    /** \brief the values are sent and kept as the base of the catch-up */
+    static constexpr int kMigrateSnapshot = 1;
+    /** \brief the change since the snapshot is sent */
+    static constexpr int kMigrateCatchUp = 2;
 
     std::string debug_string() {
       std::string s;
       s += "timestamp: " + std::to_string(timestamp) + " ";
+      s += "migrate_phase: " + std::to_string(migrate_phase) + " ";
       s += "transtopo: ";
       for (auto& [id, topo] : transtopo) {
         s += std::to_string(id) + ": " + topo.debug_string() + " ";
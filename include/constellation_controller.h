@@ -86,6 +86,14 @@ class ConstelController {
 
   bool is_sycn_add_finished_ = false;
 
+  /**
+   * \brief a joining node enters the tree this many batches after its model
+   * starts to migrate, the old nodes train meanwhile and send a catch-up when
+   * it enters. 0 migrates at the tick it enters, see
+   * CONSTEL_MIGRATE_LEAD_STEPS
+   */
+  uint32_t migrate_lead_steps_ = 0;
+
 #ifdef CONS_NETWORK_AWARE
   std::unique_ptr<moniter::Smq> test_server_;
 #endif
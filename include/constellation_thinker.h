@@ -42,6 +42,13 @@ struct StrategyRequest {
 struct StrategyBlock {
   GlobalTransTopo global_topo_;
   GlobalModelSyncConf global_model_sync_conf_;
+  /** \brief spanning trees besides global_topo_ that keys are striped over */
+  std::vector<GlobalTransTopo> extra_topos_;
+  /**
+   * \brief the share of the keys of each tree, global_topo_ first, e.g. its
+   * bottleneck bandwidth. Empty if there is only one tree.
+   */
+  std::vector<float> tree_weights_;
 };
 
 class ConstelController;
@@ -61,6 +68,36 @@ class ConstelThinker {
   virtual void checkStrategy(const StrategyRequest& req,
                              const StrategyBlock& strategy_block);
 
+  /**
+   * \brief set the scatter group of `transtopo`, the root and those of its
+   * children that reduce-scatter and all-gather large keys among themselves,
+   * which takes the reduction of those keys off the root. Members must be
+   * pairwise overlay neighbours. By default chosen by CONSTEL_COLLECTIVE:
+   * "tree" (default) none, "rsag" always, "auto" when it has at least three
+   * members.
+   */
+  virtual void chooseScatterGroup(const StrategyRequest& req,
+                                  GlobalTransTopo* transtopo);
+
+  /**
+   * \brief add the trees besides `block->global_topo_` that keys are striped
+   * over, and their weights. By default packExtraTrees with a unit capacity
+   * per link: trees edge-disjoint from each other and from the main tree,
+   * all of the same weight.
+   */
+  virtual void chooseExtraTrees(const StrategyRequest& req,
+                                StrategyBlock* block);
+
+  /**
+   * \brief pack up to CONSTEL_NUM_TREES - 1 trees (CONSTEL_NUM_TREES defaults
+   * to 1, no extra tree) into the `capacity` of the links, in the order of
+   * the overlay, the main tree leaves. Every tree, the main one first, is
+   * weighted by its bottleneck capacity.
+   */
+  void packExtraTrees(const StrategyRequest& req,
+                      const AdjacencyListT<float>& capacity,
+                      StrategyBlock* block);
+
   StrategyBlock strategy_block_;
   GlobalTransTopo& glb_topo_ = strategy_block_.global_topo_;
   GlobalModelSyncConf& glb_conf_ = strategy_block_.global_model_sync_conf_;
@@ -11,6 +11,13 @@
 
 #include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 namespace moniter {
 class Smq;
@@ -24,13 +31,23 @@ class ConstelAggEngine;
 template <typename Data, typename ResType>
 class ReturnOnAgg;
 
+template <typename T>
+class KeyTable;
+
+class Compressor;
+
 // TODO: now only support default push pull
 enum class RequestType {
   kDefaultPushPull,
   kDefaultInit,
   kModelSync,
   kRowSparsePushPull,
-  kCompressedPushPull
+  kCompressedPushPull,
+  kReduceScatter,
+  kAllGather,
+  kTreePushPull,
+  kTreeResult,
+  kModelSyncDelta
 };
 
 struct DataHandleType {
@@ -75,6 +92,40 @@ static DataHandleType DepairDataHandleType(int cmd) {
 
 class TimeRecoder;
 
+/**
+ * \brief completion of a PushPullAsync call. Once a key is done its pulled
+ * value is in the output passed to PushPullAsync.
+ */
+class PushPullHandle {
+ public:
+  explicit PushPullHandle(size_t num_keys);
+
+  /** \brief whether every key is done, never blocks */
+  bool Poll() const;
+  /** \brief block until every key is done */
+  void Wait() const;
+  /** \brief whether the i-th key of the call is done */
+  bool PollKey(size_t i) const;
+  /** \brief block until the i-th key of the call is done */
+  void WaitKey(size_t i) const;
+
+ private:
+  friend class ConstelTrainer;
+
+  /** \brief add a part (chunk or bucket slot) of the i-th key */
+  size_t AddPart(size_t key_index);
+  void MarkDone(size_t part);
+  bool IsKeyDone(size_t i) const;
+
+  mutable std::mutex mu_;
+  mutable std::condition_variable cv_;
+  std::vector<bool> part_done_;
+  size_t num_done_ = 0;
+  std::vector<std::vector<size_t>> key_parts_;
+  /** \brief chunk views and fused buffers the parts are pulled into */
+  std::deque<CArray> bufs_;
+};
+
 class ConstelTrainer {
  public:
   explicit ConstelTrainer();
@@ -124,6 +175,12 @@ class ConstelTrainer {
 
   bool BatchEnd(std::vector<int>* keys_to_migrate = nullptr);
 
+  /**
+   * \brief send the slices of the model this node migrates at the current
+   * tick. `vals` must not change after the call. With
+   * CONSTEL_MIGRATE_ASYNC it returns at once and the slices are streamed in
+   * the background while training goes on
+   */
   void Migrate(const std::vector<int>& keys, const std::vector<CArray>& vals);
 
   void Broadcast(const std::vector<int>& keys,
@@ -131,9 +188,41 @@ class ConstelTrainer {
 
   void Recv(const std::vector<int>& keys, const std::vector<CArray*>& vals);
 
+  /**
+   * \brief allreduce `vals_push` into `vals_pull`.
+   * \param priorities optional, one per key. Keys with a higher priority are
+   * reduced and sent up the tree first, e.g. the first layers that the next
+   * forward pass needs.
+   */
   void PushPull(const std::vector<int>& keys,
                 const std::vector<CArray>& vals_push,
-                const std::vector<CArray*>& vals_pull);
+                const std::vector<CArray*>& vals_pull,
+                const std::vector<int>& priorities = {});
+
+  /**
+   * \brief non-blocking PushPull, e.g. called per layer during backward.
+   * `vals_push` and `vals_pull` must stay alive until the handle is done, and
+   * a key must not be pushed again before its previous PushPull is done.
+   */
+  std::shared_ptr<PushPullHandle> PushPullAsync(
+      const std::vector<int>& keys,
+      const std::vector<CArray>& vals_push,
+      const std::vector<CArray*>& vals_pull,
+      const std::vector<int>& priorities = {});
+
+  /**
+   * \brief allreduce of row-sparse values such as embedding gradients: only
+   * the rows a trainer touched travel, and every node merges them by row id.
+   * `vals_push[i]` holds the rows `row_ids[i]` of keys[i], one after another.
+   * On return `row_ids_pull[i]` and `vals_pull[i]` hold every row touched by
+   * any trainer, summed and sorted by row id.
+   */
+  void PushPullRowSparse(const std::vector<int>& keys,
+                         const std::vector<std::vector<uint64_t>>& row_ids,
+                         const std::vector<CArray>& vals_push,
+                         std::vector<std::vector<uint64_t>>* row_ids_pull,
+                         std::vector<CArray>* vals_pull,
+                         const std::vector<int>& priorities = {});
 
   bool is_scale() const {
     return is_scale_;
@@ -148,36 +237,129 @@ class ConstelTrainer {
    */
   struct UpdateBuf {
     std::vector<ps::KVMeta> request_meta;
+    /**
+     * \brief the children a complete round answers, taken over from
+     * request_meta in the key's strand. Answering from the callback thread
+     * lets a child push the next round, which collects its own request_meta.
+     */
+    std::vector<ps::KVMeta> answer_meta;
     CArray merged;
+    /** \brief the first value pushed, referenced until a second arrives */
+    CArray first;
     size_t num = 0;
     bool shouldReset = false;
+    /**
+     * \brief persistent merge buffers, consecutive rounds use them in turn:
+     * round t+1 accumulates into one while round t is still answering the
+     * children from the other
+     */
+    CArray merge_bufs[2];
+    size_t round = 0;
+    /** \brief the round has all its values, to be reset on the next push */
+    void CompleteRound() {
+      shouldReset = true;
+      answer_meta = std::move(request_meta);
+      request_meta.clear();
+    }
     void ResetUpdateBuf() {
       if (shouldReset) {
         request_meta.clear();
         num = 0;
         shouldReset = false;
+        round++;
+      }
+    }
+    /** \brief the merge buffer of this round, only reallocated on resize */
+    const CArray& MergeBuf(size_t size, int dtype) {
+      auto& buf = merge_bufs[round % 2];
+      if (buf.isNone() || buf.size() != size) {
+        buf = CArray(size, dtype);
       }
+      buf.dtype = dtype;
+      return buf;
     }
   };
 
   enum class TaskTypeEnum {
     kPushPull,
     kBroadcastDefault,
+    /** \brief merged by row id, see row_sparse.h */
+    kRowSparsePushPull,
+    /** \brief a segment from another member of the scatter group */
+    kReduceScatter,
+    kAllGather,
+    /** \brief the result of a key on an extra tree, from the parent there */
+    kTreeResult,
   };
 
   struct EngineTaskData {
     UpdateBuf update_buf;
     TaskTypeEnum type;
     bool isFromRoot = false;
+    /** \brief engine priority, forwarded to the parent with the push */
+    int priority = 0;
+    /** \brief update_buf.merged holds a compressed push of a child */
+    bool compressed = false;
+    /**
+     * \brief the index in the scatter group of the segment carried by a
+     * reduce-scatter or all-gather message
+     */
+    int segment = -1;
+    /** \brief the spanning tree the key travels on, 0 for the main one */
+    int tree = 0;
+    /**
+     * \brief the sender's timestamp of a message on an extra tree, it waits
+     * in cached_kv_ until this node gets there
+     */
+    uint32_t timestamp = 0;
   };
 
   /**
-   * \brief update_buf_ is used to store the request meta from the son(include
-   * itself) and merged gradient
+   * \brief everything kept per key, looked up without a global lock. The
+   * engine runs one task per key at a time, which serializes `update_buf`.
    */
-  std::unordered_map<int, UpdateBuf> update_buf_;
+  struct alignas(64) KeyState {
+    /**
+     * \brief the request meta from the son(include itself) and merged
+     * gradient
+     */
+    UpdateBuf update_buf;
+    /** \brief ZPull timestamp of the pending init, -1 on the root */
+    std::atomic<int> init_waiting_ts{0};
+    /**
+     * \brief compressors of the push to the father and of the result sent
+     * down, each keeps its own error feedback residual
+     */
+    std::unique_ptr<Compressor> up_compressor;
+    std::unique_ptr<Compressor> down_compressor;
+    /** \brief the compressed push in flight */
+    CArray compressed_push;
+    /** \brief the compressed result, forwarded to the children as is */
+    CArray compressed_result;
+    /**
+     * \brief reduce-scatter/all-gather of the key among the scatter group.
+     * A round starts when the value of the subtree is reduced: the other
+     * members get their segment of it and sum it into theirs, then each
+     * member sends its summed segment to all others.
+     */
+    struct ScatterGather {
+      /** \brief the result, double buffered like the merge buffers */
+      CArray bufs[2];
+      CArray result;
+      /** \brief segments that arrived before the round started here */
+      std::deque<CArray> inbox;
+      bool started = false;
+      bool gathering = false;
+      size_t num_scattered = 0;
+      size_t num_gathered = 0;
+    } scatter_gather;
+    /** \brief the tree of the round, see EngineTaskData::tree */
+    int tree = 0;
+    /** \brief the push to the parent on an extra tree, kept until the result */
+    CArray tree_push;
+  };
 
-  std::unordered_map<int, int> init_waiting_ts_;
+  KeyTable<KeyState>* key_states_;
 
   std::unordered_map<uint32_t, std::vector<std::pair<int, EngineTaskData>>>
       cached_kv_;
@@ -192,34 +374,185 @@ class ConstelTrainer {
   ps::KVTrainer<char>* trainer_;
 
   std::atomic<bool> is_ctx_ready_{false};
+  std::mutex ctx_ready_mu_;
+  std::condition_variable ctx_ready_cv_;
 
   std::atomic<bool> is_model_sync_{false};
 
   std::mutex model_sync_mu_;
+  /**
+   * \brief signalled when Recv posts its buffers and when the last migrated
+   * byte arrives
+   */
   std::condition_variable model_sync_cv_;
   std::unordered_map<int, uint64_t> model_info_;
   uint64_t model_size_ = 0;
-  std::vector<int>* wait_recv_keys_ = nullptr;
-  std::vector<CArray*>* wait_recv_vals_ = nullptr;
+  /**
+   * \brief the buffers Recv posted by key, migrated slices are copied
+   * straight into them at their offset
+   */
+  std::unordered_map<int, CArray*> recv_bufs_;
+  bool recv_posted_ = false;
 
   std::atomic<bool> is_scale_{true};
 
-  mutable std::mutex update_buf_mu_;
-
   mutable std::mutex trans_topo_mu_;
 
-  mutable std::mutex init_waiting_ts_mu_;
-
   using EngineType = ConstelAggEngine<EngineTaskData, int>;
 
   EngineType* engine_;
 
+  /**
+   * \brief keys larger than this are reduced in chunks of this many bytes by
+   * all engine threads, see CONSTEL_REDUCE_CHUNK_BYTES
+   */
+  size_t reduce_chunk_bytes_ = 512 << 10;
+
+  /**
+   * \brief rebalance the engine key->thread map every this many batches by
+   * the measured reduction cost, 0 to disable, see CONSTEL_REBALANCE_INTERVAL
+   */
+  int64_t rebalance_interval_ = 10;
+  uint64_t num_batches_ = 0;
+
+  /**
+   * \brief keys smaller than this are packed into fusion buckets of at most
+   * this many bytes, 0 disables fusion, see CONSTEL_FUSION_BUCKET_BYTES
+   */
+  size_t fusion_bucket_bytes_ = 0;
+  /** \brief fused push/pull buffer of each bucket, reused across batches */
+  std::unordered_map<int, CArray> fusion_bufs_;
+
+  struct PendingPushPull {
+    std::shared_ptr<PushPullHandle> handle;
+    std::vector<size_t> parts;
+    CArray* out = nullptr;
+    /** \brief run after `out` is filled, e.g. to scatter a fused bucket */
+    std::function<void()> on_done;
+    /**
+     * \brief `out` takes the merged value itself instead of a copy, for
+     * results whose size is only known when they arrive
+     */
+    bool adopt = false;
+  };
+  /** \brief PushPull in flight, by key on the wire */
+  std::unordered_map<int, PendingPushPull> pending_pushpull_;
+  std::mutex pending_pushpull_mu_;
+
+  /**
+   * \brief keys larger than this are split into chunks that travel up and
+   * down the tree independently, so a parent reduces chunk k while chunk k+1
+   * is still arriving. 0 disables it, see CONSTEL_PIPELINE_CHUNK_BYTES
+   */
+  size_t pipeline_chunk_bytes_ = 4 << 20;
+
+  /**
+   * \brief float32 PushPull values of at least compress_min_bytes_ are sent
+   * compressed by this compressor, empty for none. See CONSTEL_COMPRESSOR,
+   * CONSTEL_COMPRESS_MIN_BYTES and CONSTEL_COMPRESS_ERROR_FEEDBACK
+   */
+  std::string compressor_spec_;
+  size_t compress_min_bytes_ = 64 << 10;
+  bool compress_error_feedback_ = true;
+
+  /**
+   * \brief keys of at least this many bytes are reduce-scattered and
+   * all-gathered if the node is in a scatter group, see
+   * NodeTransTopo::scatter_group and CONSTEL_SCATTER_MIN_BYTES
+   */
+  size_t scatter_min_bytes_ = 1 << 20;
+
+  /**
+   * \brief migrated model slices are sent in messages of at most this many
+   * bytes, 0 for a message per key or partial slice, with at most
+   * migrate_window_ unacknowledged per path. A relay forwards each message as
+   * it arrives, so a path streams at the speed of its slowest hop. See
+   * CONSTEL_MIGRATE_CHUNK_BYTES and CONSTEL_MIGRATE_WINDOW
+   */
+  size_t migrate_chunk_bytes_ = 1 << 20;
+  size_t migrate_window_ = 4;
+
+  /**
+   * \brief stream migrations on migrate_thread_ instead of in Migrate, one
+   * after the other so the messages of a path keep their order. See
+   * CONSTEL_MIGRATE_ASYNC
+   */
+  bool migrate_async_ = false;
+  std::unique_ptr<std::thread> migrate_thread_;
+  std::deque<std::function<void()>> migrate_tasks_;
+  std::mutex migrate_mu_;
+  std::condition_variable migrate_cv_;
+
+  /**
+   * \brief a catch-up sends the lossless change of each slice since the
+   * snapshot instead of its values, see EncodeMigrateDelta,
+   * ScaleClock::Tick::migrate_phase and CONSTEL_MIGRATE_DELTA
+   */
+  bool migrate_delta_ = true;
+  /** \brief ScaleClock::Tick::migrate_phase of model_sync_conf_ */
+  int migrate_phase_ = ScaleClock::Tick::kMigrateOnce;
+  /** \brief by key, what the last kMigrateSnapshot migration sent */
+  std::unordered_map<int, CArray> migrate_snapshot_;
+  /**
+   * \brief the snapshot a kMigrateCatchUp migration sends the change from,
+   * dropped at the next batch end whether it was used or not
+   */
+  std::unordered_map<int, CArray> migrate_base_;
+
   std::shared_ptr<TimeRecoder> batch_t_;
   std::shared_ptr<WindowedBuffer<int64_t>> rtt_window_;
 
+  KeyState* GetKeyState(int key);
+
+  /**
+   * \brief whether a PushPull value is sent compressed. Only depends on the
+   * configuration, so every node agrees on it
+   */
+  bool ShouldCompress(size_t size, int dtype) const;
+
+  /** \brief the compressor of `key` for the push up or the result down */
+  Compressor* GetCompressor(int key, bool up);
+
+  std::vector<int> GetScatterGroup() const {
+    std::unique_lock<std::mutex> lock(trans_topo_mu_);
+    return trans_topo_.scatter_group;
+  }
+
+  /**
+   * \brief the tree a PushPull of `key` travels on, by a hash of the key
+   * weighted by NodeTransTopo::tree_weights, so every node agrees on it.
+   * Compressed values stay on the main tree.
+   */
+  int PickTree(int key, size_t size, int dtype) const;
+
+  /** \brief the links of this node in the extra tree `tree` (from 1) */
+  TreeLinks GetTreeLinks(int tree) const {
+    std::unique_lock<std::mutex> lock(trans_topo_mu_);
+    CHECK_GE(tree, 1);
+    CHECK_LE(tree, trans_topo_.extra_trees.size()) << "no tree " << tree;
+    return trans_topo_.extra_trees[tree - 1];
+  }
+
+  /**
+   * \brief whether a PushPull value is reduce-scattered in the scatter group.
+   * Compressed values never are, so the members agree on it.
+   */
+  bool UseScatterGather(size_t size, int dtype) const;
+
+  /**
+   * \brief start the reduce-scatter of `partial`, the value reduced from the
+   * subtree. FinishPushPull is called once every segment is gathered.
+   */
+  void StartScatterGather(int key, const CArray& partial);
+
+  /** \brief a reduce-scatter or all-gather message of another member */
+  void ProcessScatterGather(int key, const EngineTaskData& data);
+
+  /** \brief send the summed segment to the other members once complete */
+  void AdvanceScatterGather(int key);
+
   UpdateBuf* GetUpdateBuf(int key) {
-    std::lock_guard<std::mutex> lock(update_buf_mu_);
-    return &update_buf_[key];
+    return &GetKeyState(key)->update_buf;
   }
 
   inline void SetNodeTransTopo(const NodeTransTopo& topo) {
@@ -229,15 +562,28 @@ class ConstelTrainer {
     trans_topo_ = topo;
   }
 
-  void MigrateFullSlice(const std::vector<int>& path,
-                        const std::vector<int>& keys,
-                        const std::vector<CArray>& vals,
-                        const KVSlice& kvslice);
+  /**
+   * \brief stream the slices of `conf` this node sends along its paths. If
+   * `base` is not empty, slices are sent as their change from `base`
+   */
+  void StreamMigration(const ModelSycnConf& conf,
+                       const std::vector<int>& keys,
+                       const std::vector<CArray>& vals,
+                       const std::vector<CArray>& base = {});
+
+  /** \brief run the migrations queued by Migrate until a null task */
+  void MigrateLoop();
 
-  void MigratePartialSlice(const std::vector<int>& path,
-                           const std::vector<int>& keys,
-                           const std::vector<CArray>& vals,
-                           const KVSlice& kvslice);
+  /**
+   * \brief send a chunk of the model to the next node of `path`, `on_ack`
+   * runs when the next node acknowledges it
+   */
+  void MigrateChunk(const std::vector<int>& path,
+                    const std::vector<int>& keys,
+                    const std::vector<CArray>& vals,
+                    const std::vector<CArray>& base,
+                    const KVSlice& kvslice,
+                    const std::function<void()>& on_ack);
 
   int SimplePushPullDefault(int key, const CArray& val);
 
@@ -245,6 +591,33 @@ class ConstelTrainer {
 
   void InitEngine(size_t num_thread);
 
+  /** \brief push keys on the wire (user, fused or chunk keys) to the engine */
+  void SubmitPushPull(const std::vector<int>& keys,
+                      const std::vector<CArray>& vals_push,
+                      const std::vector<int>& priorities,
+                      TaskTypeEnum type = TaskTypeEnum::kPushPull);
+
+  /** \brief register the PushPull of each key on the wire before it starts */
+  void AddPendingPushPull(const std::vector<int>& keys,
+                          std::vector<PendingPushPull>* pendings);
+
+  /**
+   * \brief called when the merged value of `key` is final (pulled back from
+   * the father, or reduced on the root): fill the output, answer the
+   * children and complete the handle
+   */
+  void FinishPushPull(int key);
+
+  /** \brief dst += src, chunked over the engine threads for large buffers */
+  void ParallelSum(void* dst, const void* src, size_t len, int dtype);
+
+  /** \brief dst = src1 + src2, `dst` may alias either source */
+  void ParallelSum(void* dst,
+                   const void* src1,
+                   const void* src2,
+                   size_t len,
+                   int dtype);
+
   void ProcessPushData(int key,
                        const EngineTaskData& data,
                        std::shared_ptr<ReturnOnAgg<EngineTaskData, int>> rt);
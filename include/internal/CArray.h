@@ -2,32 +2,62 @@
 #define CONSTELLATION_CARRAY_H
 
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+
+#include "memory_pool.h"
 
 namespace constellation {
 // reffer to byteps:
 // https://github.com/bytedance/byteps/blob/master/byteps/common/common.h
-// TODO: Add more data type
 enum class ConstelDataType {
   CONSTEL_FLOAT32 = 0,
+  CONSTEL_FLOAT64 = 1,
+  CONSTEL_FLOAT16 = 2,
+  CONSTEL_UINT8 = 3,
+  CONSTEL_INT32 = 4,
+  CONSTEL_INT8 = 5,
+  CONSTEL_INT64 = 6,
+  CONSTEL_BFLOAT16 = 7,
 };
 
+/** @brief the size in bytes of one element of `dtype` */
+inline size_t GetDataTypeSize(int dtype) {
+  switch (static_cast<ConstelDataType>(dtype)) {
+    case ConstelDataType::CONSTEL_FLOAT32:
+    case ConstelDataType::CONSTEL_INT32:
+      return 4;
+    case ConstelDataType::CONSTEL_FLOAT64:
+    case ConstelDataType::CONSTEL_INT64:
+      return 8;
+    case ConstelDataType::CONSTEL_FLOAT16:
+    case ConstelDataType::CONSTEL_BFLOAT16:
+      return 2;
+    case ConstelDataType::CONSTEL_UINT8:
+    case ConstelDataType::CONSTEL_INT8:
+      return 1;
+    default:
+      throw std::runtime_error("CArray: unsupported dtype " +
+                               std::to_string(dtype));
+  }
+}
+
 struct CArray {
   struct DataTrunk {
     char* dptr_;
+    size_t size_;
 
-    DataTrunk(size_t size = 0) {
-      if (size == 0) {
-        dptr_ = nullptr;
-        return;
-      }
-      dptr_ = new char[size];
-      if (!dptr_) {
-        std::runtime_error("CArray: out of memory");
-      }
-    }
+    // buffers come from the pool, 64-byte aligned and reused across
+    // iterations
+    DataTrunk(size_t size = 0)
+        : dptr_(static_cast<char*>(MemoryPool::Get()->Alloc(size))),
+          size_(size) {}
     ~DataTrunk() {
       if (dptr_) {
-        delete[] dptr_;
+        MemoryPool::Get()->Free(dptr_, size_);
         dptr_ = nullptr;
       }
     }
@@ -44,6 +74,9 @@ struct CArray {
   // if this carray get the data ptr from other struct such as torch.tensor,
   // just record the ptr and should not free it
   void* borrowed_data{nullptr};
+  // keeps a borrowed buffer alive when its ownership is shared, e.g. a
+  // received ps::SArray
+  std::shared_ptr<void> owner_;
 
   explicit CArray() : dtype(0), sptr_(nullptr) {}
   explicit CArray(size_t size, int dtype = 0)
@@ -54,6 +87,16 @@ struct CArray {
         size_(size),
         dtype(dtype),
         sptr_(nullptr) {}
+  // share the ownership of a buffer allocated elsewhere without copying it
+  explicit CArray(std::shared_ptr<void> owner,
+                  const void* data,
+                  size_t size,
+                  int dtype = 0)
+      : borrowed_data(const_cast<void*>(data)),
+        owner_(std::move(owner)),
+        size_(size),
+        dtype(dtype),
+        sptr_(nullptr) {}
   CArray(CArray&& other) = default;
   CArray(const CArray& other) = default;
   CArray& operator=(CArray&& other) = default;
@@ -0,0 +1,102 @@
+#ifndef CONSTELLATION_MEMORY_POOL_H
+#define CONSTELLATION_MEMORY_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace constellation {
+
+/**
+ * @brief size-class pool of aligned buffers, backing CArray.
+ *
+ * Sizes are rounded up to one of four classes per power of two, so a freed
+ * buffer is reused by the next allocation of about the same size. Buffers are
+ * 64-byte aligned; buffers of 2MB and more are 2MB aligned and, with
+ * CONSTEL_POOL_HUGEPAGE=1, advised to use transparent huge pages.
+ *
+ * Small buffers are cached per thread first, large ones go to a shared free
+ * list so they can be reused by any thread. CONSTEL_MEMORY_POOL=0 disables
+ * caching (every buffer goes back to the system).
+ *
+ * At most CONSTEL_POOL_MAX_CACHED_MB (default 512, 0 for no limit) of free
+ * buffers are kept, a buffer freed beyond that goes back to the system, so
+ * sizes that change every round do not pile up.
+ */
+class MemoryPool {
+ public:
+  struct Stats {
+    /** @brief allocations served from a cached buffer */
+    uint64_t hits = 0;
+    /** @brief allocations that had to ask the system */
+    uint64_t misses = 0;
+    /** @brief bytes of free buffers held by the pool */
+    uint64_t bytes_cached = 0;
+    /** @brief bytes of buffers handed out and not yet freed */
+    uint64_t bytes_in_use = 0;
+  };
+
+  static MemoryPool* Get();
+
+  /** @brief an aligned buffer of at least `size` bytes, nullptr if size is 0 */
+  void* Alloc(size_t size);
+
+  /** @brief give back a buffer returned by Alloc(size) */
+  void Free(void* ptr, size_t size);
+
+  Stats GetStats() const;
+
+  /**
+   * @brief return cached buffers of the shared free list to the system,
+   * largest first, until at most `keep_bytes` are cached
+   */
+  void Trim(uint64_t keep_bytes = 0);
+
+  /** @brief the limit of cached bytes, 0 for none */
+  void SetMaxCachedBytes(uint64_t bytes) {
+    max_cached_bytes_ = bytes;
+  }
+  uint64_t GetMaxCachedBytes() const {
+    return max_cached_bytes_.load();
+  }
+
+  /** @brief the size actually allocated for a request of `size` bytes */
+  static size_t ClassSize(size_t size);
+
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kHugePageSize = size_t(1) << 21;
+  /** @brief larger buffers skip the per-thread caches */
+  static constexpr size_t kMaxThreadCacheSize = size_t(1) << 20;
+  static constexpr size_t kThreadCacheBlocks = 8;
+  static constexpr int kNumClasses = 256;
+
+ private:
+  friend struct ThreadCache;
+
+  MemoryPool();
+
+  static int ClassIndex(size_t size, size_t* class_size);
+  static size_t ClassSizeOf(int idx);
+  void* SystemAlloc(size_t class_size);
+  void SystemFree(void* ptr);
+  /** @brief pop a buffer of class `idx` from the shared list, or nullptr */
+  void* PopShared(int idx);
+  void PushShared(int idx, void* ptr);
+
+  bool enabled_;
+  bool huge_page_;
+  std::mutex mu_;
+  std::vector<void*> free_[kNumClasses];
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> bytes_cached_{0};
+  std::atomic<uint64_t> bytes_in_use_{0};
+  std::atomic<uint64_t> max_cached_bytes_;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_MEMORY_POOL_H
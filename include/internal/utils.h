@@ -8,6 +8,14 @@
 namespace constellation {
 int64_t get_time_point(const char* unit);
 
+/** @brief integer value of the environment variable `name`, or `default_val`
+ * if it is unset or not a number */
+int64_t get_env(const char* name, int64_t default_val);
+
+/** @brief string value of the environment variable `name`, or `default_val`
+ * if it is unset */
+std::string get_env_str(const char* name, const std::string& default_val);
+
 }  // namespace constellation
 
 #endif  // CONSTELLATION_UTILS_H
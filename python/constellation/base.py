@@ -16,11 +16,37 @@ c_uint = ctypes.c_uint
 # Data Types
 class ConsDataTypeEnum(enum.Enum):
     FLOAT32 = 0
-
-
-ConsDataTypeByteSize = {ConsDataTypeEnum.FLOAT32: 4}
-
-ConsDataTypeCType = {ConsDataTypeEnum.FLOAT32: ctypes.c_float}
+    FLOAT64 = 1
+    FLOAT16 = 2
+    UINT8 = 3
+    INT32 = 4
+    INT8 = 5
+    INT64 = 6
+    BFLOAT16 = 7
+
+
+ConsDataTypeByteSize = {
+    ConsDataTypeEnum.FLOAT32: 4,
+    ConsDataTypeEnum.FLOAT64: 8,
+    ConsDataTypeEnum.FLOAT16: 2,
+    ConsDataTypeEnum.UINT8: 1,
+    ConsDataTypeEnum.INT32: 4,
+    ConsDataTypeEnum.INT8: 1,
+    ConsDataTypeEnum.INT64: 8,
+    ConsDataTypeEnum.BFLOAT16: 2,
+}
+
+# half types have no ctypes counterpart, they are carried as raw 16-bit words
+ConsDataTypeCType = {
+    ConsDataTypeEnum.FLOAT32: ctypes.c_float,
+    ConsDataTypeEnum.FLOAT64: ctypes.c_double,
+    ConsDataTypeEnum.FLOAT16: ctypes.c_int16,
+    ConsDataTypeEnum.UINT8: ctypes.c_uint8,
+    ConsDataTypeEnum.INT32: ctypes.c_int32,
+    ConsDataTypeEnum.INT8: ctypes.c_int8,
+    ConsDataTypeEnum.INT64: ctypes.c_int64,
+    ConsDataTypeEnum.BFLOAT16: ctypes.c_int16,
+}
 
 
 def get_basic_type_byte_size(dtype):
@@ -14,6 +14,9 @@ THINKER_NAME = [
     "FAPTTimeWeightedConfThinker",
     "RoundRobinTimeWeightedThinker",
     "LayerwiseTimeWeightedConfThinker",
+    "MaxBottleneckTreeThinker",
+    "IncrementalTreeThinker",
+    "MaxFlowConfThinker",
 ]
 
 
@@ -8,7 +8,16 @@ from ..base import CArrayDataPtr, ConsDataTypeEnum, get_basic_type_byte_size
 from ..trainer import ConstelTrainer, create_trainer_handle
 from ..carray import CArrayBase, TensorMixinBase
 
-PYTORCH_TENSOR_TYPE = {torch.float32: ConsDataTypeEnum.FLOAT32}
+PYTORCH_TENSOR_TYPE = {
+    torch.float32: ConsDataTypeEnum.FLOAT32,
+    torch.float64: ConsDataTypeEnum.FLOAT64,
+    torch.float16: ConsDataTypeEnum.FLOAT16,
+    torch.uint8: ConsDataTypeEnum.UINT8,
+    torch.int32: ConsDataTypeEnum.INT32,
+    torch.int8: ConsDataTypeEnum.INT8,
+    torch.int64: ConsDataTypeEnum.INT64,
+    torch.bfloat16: ConsDataTypeEnum.BFLOAT16,
+}
 
 __all__ = ["Trainer", "CArray"]
 
@@ -74,7 +83,12 @@ class CArray(CArrayBase, PyTorchTensorMixin):
         buffer_np = np.ctypeslib.as_array(
             carray.ctypes_data_ptr(), shape=(self.bytes_size_ // type_bytes_size,)
         )
-        carray.tensor_ = torch.from_numpy(buffer_np).view(self.origin_tensor_.shape)
+        # half types come back as int16 words, reinterpret them as the tensor dtype
+        carray.tensor_ = (
+            torch.from_numpy(buffer_np)
+            .view(self.tensor_.dtype)
+            .view(self.origin_tensor_.shape)
+        )
         return carray
 
     def _update_tensor(self, scale=1):
@@ -117,7 +131,7 @@ class Trainer(ConstelTrainer):
         self._carray_repo.clear()
         return super().__del__()
 
-    def allreduce(self, keys, values, out=None):
+    def allreduce(self, keys, values, out=None, priority=None):
         self._rank = self.rank
         self._num_trainers = self.num_trainers
         values_carray = self._convert_to_carray(values)
@@ -126,11 +140,32 @@ class Trainer(ConstelTrainer):
             out_carray = None
         else:
             out_carray = self._convert_to_carray(out)
-        super().allreduce(keys, values_carray, out_carray)
+        super().allreduce(keys, values_carray, out_carray, priority)
         CArray.update_tensor(out_carray, self._num_trainers)
 
-    def _recv(self, keys, values):
+    def allreduce_async(self, keys, values, out=None, priority=None):
+        """Start an allreduce, the tensors in ``out`` are updated on wait."""
+        self._rank = self.rank
+        self._num_trainers = self.num_trainers
         values_carray = self._convert_to_carray(values)
+        out = out if out is not None else values
+        out_carray = self._convert_to_carray(out)
+        num_trainers = self._num_trainers
+        return super().allreduce_async(
+            keys,
+            values_carray,
+            out_carray,
+            priority,
+            on_done=lambda: CArray.update_tensor(out_carray, num_trainers),
+        )
+
+    def _recv(self, keys, values):
+        # borrow the tensors (no clone), the migrated bytes land in them
+        # directly unless they need a cpu copy
+        values_carray = self._convert_to_carray(
+            values,
+            map_func=lambda item, *args, **kwargs: CArray(item, *args, **kwargs),
+        )
         super()._recv(keys, values_carray)
         CArray.update_tensor(values_carray)
 
@@ -232,6 +267,7 @@ class Trainer(ConstelTrainer):
             if param.grad is not None
         ]
         keys, grads = zip(*keys_grads)
-        self.allreduce(keys, grads)
+        # the next forward pass needs the first layers first
+        self.allreduce(keys, grads, priority=[-key for key in keys])
         self._optimizer.step()
         self._optimizer.zero_grad(set_to_none=False)
@@ -9,7 +9,7 @@ from .base import _LIB, check_call, TrainerHandle, c_str, c_array, c_array_buf,
 from .carray import CArrayBase
 import json
 
-__all__ = ["ConstelTrainer", "create_trainer_handle"]
+__all__ = ["ConstelTrainer", "PushPullHandle", "create_trainer_handle"]
 
 
 def _c_carray_handles_array(carrays):
@@ -52,13 +52,60 @@ def check_keys_unique(keys):
     return True
 
 
+class PushPullHandle(object):
+    """Completion of an ``allreduce_async`` call.
+
+    Keeps the pushed and pulled CArrays alive until the handle is gone, so
+    they must not be reused before ``wait`` returns or ``poll`` is True.
+    """
+
+    def __init__(self, handle, carrays, on_done=None):
+        self.handle = handle
+        self._carrays = carrays
+        self._on_done = on_done
+        self._done = False
+
+    def __del__(self):
+        check_call(_LIB.ConstellationPushPullHandleFree(self.handle))
+
+    def _finish(self):
+        if not self._done:
+            self._done = True
+            if self._on_done is not None:
+                self._on_done()
+
+    def poll(self):
+        """Return True if every key is done, never blocks."""
+        if self._done:
+            return True
+        done = ctypes.c_int()
+        check_call(
+            _LIB.ConstellationPushPullHandlePoll(self.handle, ctypes.byref(done))
+        )
+        if done.value:
+            self._finish()
+        return self._done
+
+    def wait(self):
+        """Block until every key is done."""
+        if not self._done:
+            check_call(_LIB.ConstellationPushPullHandleWait(self.handle))
+            self._finish()
+
+
 class ConstelTrainerBase(object):
     """An Abstract Class for Constellation Trainers."""
 
     def broadcast(self, keys, values):
         raise NotImplementedError
 
-    def allreduce(self, keys, values, out):
+    def allreduce(self, keys, values, out, priority=None):
+        raise NotImplementedError
+
+    def allreduce_async(self, keys, values, out, priority=None):
+        raise NotImplementedError
+
+    def allreduce_row_sparse(self, key, row_ids, values, out, max_rows):
         raise NotImplementedError
 
     @property
@@ -230,7 +277,63 @@ class ConstelTrainer(ConstelTrainerBase):
         assert check_keys(keys, keys_to_migrate)
         self._migrate(keys, values)
 
-    def allreduce(self, keys, values, out=None):
+    def allreduce(self, keys, values, out=None, priority=None):
+        """Allreduce ``values`` into ``out``.
+
+        ``priority`` is an optional int per key (or one int for a single key).
+        Keys with a higher priority are reduced and sent first, e.g. give the
+        first layers the highest priority so the next forward pass can start
+        before the whole model is synced.
+        """
+        assert check_keys_unique(
+            keys
+        ), "Have not supported multiple device yet. Keys must be unique."
+
+        ckeys, cvalues = _ctype_key_value_cast(keys, values)
+        if out is not None:
+            ckeys_out, c_values_out = _ctype_key_value_cast(keys, out)
+        else:
+            ckeys_out, c_values_out = ckeys, cvalues
+
+        if priority is None:
+            check_call(
+                _LIB.ConstellationTrainerPushPull(
+                    self.handle,
+                    c_uint(len(ckeys)),
+                    ckeys,
+                    c_uint(len(ckeys_out)),
+                    ckeys_out,
+                    cvalues,
+                    c_values_out,
+                )
+            )
+            return
+
+        if not isinstance(priority, (list, tuple)):
+            priority = [priority]
+        assert len(priority) == len(
+            ckeys
+        ), "The length of keys and priority must be the same."
+        check_call(
+            _LIB.ConstellationTrainerPushPullWithPriority(
+                self.handle,
+                c_uint(len(ckeys)),
+                ckeys,
+                c_uint(len(ckeys_out)),
+                ckeys_out,
+                cvalues,
+                c_values_out,
+                c_array(ctypes.c_int, priority),
+            )
+        )
+
+    def allreduce_async(self, keys, values, out=None, priority=None, on_done=None):
+        """Start an allreduce of ``values`` into ``out`` and return at once.
+
+        Returns a ``PushPullHandle``; ``out`` holds the result after its
+        ``wait`` returns or its ``poll`` gives True, and ``on_done`` (if any)
+        is called there. Compute can overlap with the communication meanwhile.
+        """
         assert check_keys_unique(
             keys
         ), "Have not supported multiple device yet. Keys must be unique."
@@ -239,10 +342,21 @@ class ConstelTrainer(ConstelTrainerBase):
         if out is not None:
             ckeys_out, c_values_out = _ctype_key_value_cast(keys, out)
         else:
+            out = values
             ckeys_out, c_values_out = ckeys, cvalues
 
+        cpriority = None
+        if priority is not None:
+            if not isinstance(priority, (list, tuple)):
+                priority = [priority]
+            assert len(priority) == len(
+                ckeys
+            ), "The length of keys and priority must be the same."
+            cpriority = c_array(ctypes.c_int, priority)
+
+        handle = ctypes.c_void_p()
         check_call(
-            _LIB.ConstellationTrainerPushPull(
+            _LIB.ConstellationTrainerPushPullAsync(
                 self.handle,
                 c_uint(len(ckeys)),
                 ckeys,
@@ -250,8 +364,39 @@ class ConstelTrainer(ConstelTrainerBase):
                 ckeys_out,
                 cvalues,
                 c_values_out,
+                cpriority,
+                ctypes.byref(handle),
+            )
+        )
+        return PushPullHandle(handle, (values, out), on_done)
+
+    def allreduce_row_sparse(self, key, row_ids, values, out, max_rows):
+        """Allreduce the rows ``row_ids`` of ``values``, e.g. the rows of an
+        embedding table touched by the batch, and return the pulled row ids.
+
+        Only the pushed rows travel. ``out`` must have room for ``max_rows``
+        rows; it receives every row pushed by any trainer, summed and in the
+        order of the returned ids.
+        """
+        assert isinstance(key, int), "Only support one int key."
+        row_ids = list(row_ids)
+        num_rows_out = (ctypes.c_uint64 * 1)()
+        row_ids_out = (ctypes.c_uint64 * max_rows)()
+        check_call(
+            _LIB.ConstellationTrainerPushPullRowSparse(
+                self.handle,
+                c_uint(1),
+                c_array(ctypes.c_int, [key]),
+                c_array(ctypes.c_uint64, [len(row_ids)]),
+                c_array(ctypes.c_uint64, row_ids),
+                _c_carray_handles_array([values]),
+                c_array(ctypes.c_uint64, [max_rows]),
+                num_rows_out,
+                row_ids_out,
+                _c_carray_handles_array([out]),
             )
         )
+        return list(row_ids_out[: num_rows_out[0]])
 
     def broadcast(self, keys, values):
         assert check_keys_unique(
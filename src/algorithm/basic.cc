@@ -3,6 +3,10 @@
 #include <random>
 #include <queue>
 #include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <tuple>
 
 namespace constellation::algorithm::basic {
 
@@ -106,6 +110,532 @@ GlobalTransTopo random_choose_tree(const AdjacencyList& overlay) {
   return transtopo;
 }
 
+std::vector<int> set_scatter_group(
+    GlobalTransTopo& transtopo,
+    const AdjacencyList& overlay,
+    const std::function<bool(int, int)>& linkable) {
+  auto linked = [&](int u, int v) {
+    auto it = overlay.find(u);
+    return it != overlay.end() && std_isin(v, it->second) &&
+           (!linkable || linkable(u, v));
+  };
+  std::vector<int> group;
+  for (const auto& [id, topo] : transtopo) {
+    if (topo.getType() != NodeTransTopo::Type::kRoot) {
+      continue;
+    }
+    std::vector<int> children;
+    for (int child : topo.getChildren()) {
+      if (linked(id, child)) {
+        children.push_back(child);
+      }
+    }
+    std::unordered_map<int, int> degree;
+    for (int u : children) {
+      for (int v : children) {
+        degree[u] += u != v && linked(u, v);
+      }
+    }
+    std::stable_sort(children.begin(), children.end(), [&](int u, int v) {
+      return degree[u] > degree[v];
+    });
+    group.push_back(id);
+    for (int child : children) {
+      if (std::all_of(group.begin() + 1, group.end(), [&](int member) {
+            return linked(child, member);
+          })) {
+        group.push_back(child);
+      }
+    }
+    break;
+  }
+  if (group.size() < 2) {
+    group.clear();
+  }
+  for (auto& [id, topo] : transtopo) {
+    topo.scatter_group = std_isin(id, group) ? group : std::vector<int>();
+  }
+  return group;
+}
+
+namespace {
+
+/* brief: root a tree at its center, the node of the smallest depth */
+GlobalTransTopo root_at_center(const AdjacencyList& tree) {
+  auto bfs = [&tree](int root, std::unordered_map<int, int>* parent) {
+    std::queue<int> q;
+    std::unordered_map<int, int> depth = {{root, 0}};
+    q.push(root);
+    int max_depth = 0;
+    while (!q.empty()) {
+      int u = q.front();
+      q.pop();
+      for (int v : tree.at(u)) {
+        if (depth.count(v) == 0) {
+          depth[v] = depth[u] + 1;
+          max_depth = std::max(max_depth, depth[v]);
+          if (parent) {
+            (*parent)[v] = u;
+          }
+          q.push(v);
+        }
+      }
+    }
+    return max_depth;
+  };
+  std::vector<int> nodes;
+  for (const auto& [node, _] : tree) {
+    nodes.push_back(node);
+  }
+  std::sort(nodes.begin(), nodes.end());
+  int root = nodes[0];
+  int best = bfs(root, nullptr);
+  for (int node : nodes) {
+    int depth = bfs(node, nullptr);
+    if (depth < best) {
+      best = depth;
+      root = node;
+    }
+  }
+  std::unordered_map<int, int> parent;
+  bfs(root, &parent);
+  GlobalTransTopo transtopo;
+  transtopo[root].setoRoot();
+  for (int node : nodes) {
+    if (node != root) {
+      transtopo[node].setParent(parent[node]);
+      transtopo[parent[node]].addChildren(node);
+    }
+  }
+  return transtopo;
+}
+
+/* brief: the value of each undirected edge, the smaller direction */
+std::map<std::pair<int, int>, float> edge_values(
+    const AdjacencyList& overlay,
+    const AdjacencyListT<float>& values,
+    std::unordered_set<int>* nodes) {
+  std::map<std::pair<int, int>, float> edges;
+  for (const auto& [u, neighbors] : overlay) {
+    nodes->insert(u);
+    const auto& vals = values.at(u);
+    for (size_t i = 0; i < neighbors.size(); ++i) {
+      std::pair<int, int> e = std::minmax(u, neighbors[i]);
+      auto it = edges.find(e);
+      if (it == edges.end()) {
+        edges.emplace(e, vals[i]);
+      } else {
+        it->second = std::min(it->second, vals[i]);
+      }
+    }
+  }
+  return edges;
+}
+
+/* brief: grow a tree from root over the widest edge that keeps the bounds,
+ * Prim's algorithm on bandwidths. Empty if it cannot reach every node */
+GlobalTransTopo grow_widest_tree(
+    int root,
+    const AdjacencyList& overlay,
+    const std::map<std::pair<int, int>, float>& bandwidth,
+    int max_depth,
+    int max_fanout,
+    float* bottleneck) {
+  // (bandwidth, -child, -parent): the widest first, then the smaller ids
+  using Candidate = std::tuple<float, int, int>;
+  std::priority_queue<Candidate> candidates;
+  std::unordered_map<int, int> depth = {{root, 0}};
+  GlobalTransTopo transtopo;
+  transtopo[root].setoRoot();
+  *bottleneck = std::numeric_limits<float>::infinity();
+  auto expand = [&](int u) {
+    if (max_depth > 0 && depth[u] >= max_depth) {
+      return;
+    }
+    for (int v : overlay.at(u)) {
+      if (depth.count(v) == 0) {
+        candidates.emplace(bandwidth.at(std::minmax(u, v)), -v, -u);
+      }
+    }
+  };
+  expand(root);
+  while (!candidates.empty() && depth.size() < overlay.size()) {
+    auto [bw, v, u] = candidates.top();
+    candidates.pop();
+    v = -v;
+    u = -u;
+    int fanout = transtopo[u].getChildren().size();
+    if (depth.count(v) || (max_fanout > 0 && fanout >= max_fanout)) {
+      continue;
+    }
+    depth[v] = depth[u] + 1;
+    transtopo[u].addChildren(v);
+    transtopo[v].setParent(u);
+    *bottleneck = std::min(*bottleneck, bw);
+    expand(v);
+  }
+  if (depth.size() < overlay.size()) {
+    transtopo.clear();
+  }
+  return transtopo;
+}
+
+/* brief: a tree as the parent of each node, 0 for the root */
+using ParentMap = std::map<int, int>;
+
+GlobalTransTopo to_transtopo(const ParentMap& parent) {
+  GlobalTransTopo transtopo;
+  for (const auto& [v, p] : parent) {
+    if (p == 0) {
+      transtopo[v].setoRoot();
+    } else {
+      transtopo[v].setParent(p);
+      transtopo[p].addChildren(v);
+    }
+  }
+  return transtopo;
+}
+
+bool within_bounds(const ParentMap& parent, int max_depth, int max_fanout) {
+  std::unordered_map<int, int> fanout;
+  for (const auto& [v, p] : parent) {
+    if (p != 0 && max_fanout > 0 && ++fanout[p] > max_fanout) {
+      return false;
+    }
+    int depth = 0;
+    for (int u = p; u != 0 && max_depth > 0; u = parent.at(u)) {
+      if (++depth > max_depth) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* brief: whether u is v or below it */
+bool in_subtree(const ParentMap& parent, int u, int v) {
+  for (; u != 0; u = parent.at(u)) {
+    if (u == v) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+std::vector<GlobalTransTopo> pack_spanning_trees(
+    const AdjacencyList& overlay,
+    const AdjacencyListT<float>& capacity,
+    size_t max_trees,
+    std::vector<float>* bottlenecks) {
+  using Edge = std::pair<int, int>;
+  std::unordered_set<int> nodes;
+  auto left = edge_values(overlay, capacity, &nodes);
+  std::vector<GlobalTransTopo> trees;
+  std::vector<float> tree_bottlenecks;
+  while (nodes.size() > 1 && trees.size() < max_trees) {
+    // Kruskal on the capacity left, the largest first. Among equal ones
+    // the edge between the nodes with the most links left wins, which keeps
+    // the rest connected for the next trees (no stars on a clique)
+    std::vector<Edge> edges;
+    std::unordered_map<int, int> degree;
+    for (const auto& [e, cap] : left) {
+      if (cap > 0) {
+        edges.push_back(e);
+        degree[e.first]++;
+        degree[e.second]++;
+      }
+    }
+    algorithm::helper::UnionFind<int> uf(nodes);
+    AdjacencyList tree;
+    std::vector<Edge> used;
+    while (used.size() + 1 < nodes.size()) {
+      auto rank = [&](const Edge& e) {
+        int a = degree[e.first], b = degree[e.second];
+        return std::make_tuple(left.at(e), std::min(a, b), std::max(a, b));
+      };
+      auto best = edges.end();
+      for (auto it = edges.begin(); it != edges.end(); ++it) {
+        if (uf.find(it->first) != uf.find(it->second) &&
+            (best == edges.end() || rank(*it) > rank(*best))) {
+          best = it;
+        }
+      }
+      if (best == edges.end()) {
+        break;
+      }
+      auto [u, v] = *best;
+      uf.unionSets(u, v);
+      tree[u].push_back(v);
+      tree[v].push_back(u);
+      used.emplace_back(u, v);
+      degree[u]--;
+      degree[v]--;
+      edges.erase(best);
+    }
+    if (used.size() + 1 != nodes.size()) {
+      break;  // the capacity left does not connect all nodes
+    }
+    float bottleneck = std::numeric_limits<float>::infinity();
+    for (const auto& e : used) {
+      bottleneck = std::min(bottleneck, left.at(e));
+    }
+    for (const auto& e : used) {
+      left[e] -= bottleneck;
+    }
+    trees.push_back(root_at_center(tree));
+    tree_bottlenecks.push_back(bottleneck);
+  }
+  if (bottlenecks) {
+    bottlenecks->swap(tree_bottlenecks);
+  }
+  return trees;
+}
+
+float take_tree_capacity(const GlobalTransTopo& tree,
+                         const AdjacencyList& overlay,
+                         const AdjacencyListT<float>& capacity,
+                         AdjacencyListT<float>* left) {
+  std::unordered_set<int> nodes;
+  auto edges = edge_values(overlay, capacity, &nodes);
+  std::set<std::pair<int, int>> used;
+  float bottleneck = std::numeric_limits<float>::infinity();
+  for (const auto& [id, topo] : tree) {
+    if (topo.getType() == NodeTransTopo::Type::kRoot) {
+      continue;
+    }
+    std::pair<int, int> e = std::minmax(id, topo.getParent());
+    auto it = edges.find(e);
+    if (it == edges.end()) {
+      throw std::runtime_error("The tree edge " + std::to_string(e.first) +
+                               "-" + std::to_string(e.second) +
+                               " is not in the overlay");
+    }
+    used.insert(e);
+    bottleneck = std::min(bottleneck, it->second);
+  }
+  if (used.empty()) {
+    bottleneck = 0;
+  }
+  if (left) {
+    left->clear();
+    for (const auto& [u, neighbors] : overlay) {
+      auto& caps = (*left)[u];
+      for (int v : neighbors) {
+        std::pair<int, int> e = std::minmax(u, v);
+        caps.push_back(edges.at(e) - (used.count(e) ? bottleneck : 0.0f));
+      }
+    }
+  }
+  return bottleneck;
+}
+
+double estimate_allreduce_time(const GlobalTransTopo& transtopo,
+                               const AdjacencyList& overlay,
+                               const AdjacencyListT<float>& bandwidth,
+                               const TreeCostModel& model) {
+  std::unordered_set<int> nodes;
+  auto edges = edge_values(overlay, bandwidth, &nodes);
+  auto send_time = [&](int u, int v) {
+    auto it = edges.find(std::minmax(u, v));
+    double bw = it == edges.end() ? 0 : it->second;
+    return bw > 0 ? model.bytes * 8 / (bw * 1e6)
+                  : std::numeric_limits<double>::infinity();
+  };
+  double reduce_time =
+      model.reduce_rate > 0 ? model.bytes / model.reduce_rate : 0;
+  // the time a node has the sum of its subtree. Its children share its link,
+  // it receives them one after another as they are done, then sums them
+  std::function<double(int)> reduced = [&](int u) {
+    const auto& children = transtopo.at(u).getChildren();
+    std::vector<std::pair<double, double>> arrivals;
+    for (int v : children) {
+      arrivals.emplace_back(reduced(v) + model.latency, send_time(u, v));
+    }
+    std::sort(arrivals.begin(), arrivals.end());
+    double done = 0;
+    for (const auto& [ready, send] : arrivals) {
+      done = std::max(done, ready) + send;
+    }
+    return done + children.size() * reduce_time;
+  };
+  // the time the last node of a subtree has the result, the child of the
+  // longest subtree is sent to first
+  std::function<double(int)> broadcast = [&](int u) {
+    std::vector<std::pair<double, int>> subtrees;
+    for (int v : transtopo.at(u).getChildren()) {
+      subtrees.emplace_back(broadcast(v), v);
+    }
+    std::sort(subtrees.rbegin(), subtrees.rend());
+    double sent = 0, done = 0;
+    for (const auto& [rest, v] : subtrees) {
+      sent += send_time(u, v);
+      done = std::max(done, sent + model.latency + rest);
+    }
+    return done;
+  };
+  for (const auto& [id, topo] : transtopo) {
+    if (topo.getType() == NodeTransTopo::Type::kRoot) {
+      return reduced(id) + broadcast(id);
+    }
+  }
+  return 0;
+}
+
+GlobalTransTopo max_bottleneck_tree(const AdjacencyList& overlay,
+                                    const AdjacencyListT<float>& bandwidth,
+                                    int max_depth,
+                                    int max_fanout,
+                                    const TreeCostModel& model,
+                                    float* bottleneck) {
+  std::unordered_set<int> nodes;
+  auto edges = edge_values(overlay, bandwidth, &nodes);
+  std::vector<int> roots(nodes.begin(), nodes.end());
+  std::sort(roots.begin(), roots.end());
+  GlobalTransTopo best;
+  float best_bottleneck = 0;
+  double best_time = std::numeric_limits<double>::infinity();
+  for (int root : roots) {
+    float bn;
+    auto tree =
+        grow_widest_tree(root, overlay, edges, max_depth, max_fanout, &bn);
+    if (tree.empty()) {
+      continue;
+    }
+    double time = estimate_allreduce_time(tree, overlay, bandwidth, model);
+    if (best.empty() || bn > best_bottleneck ||
+        (bn == best_bottleneck && time < best_time)) {
+      best = std::move(tree);
+      best_bottleneck = bn;
+      best_time = time;
+    }
+  }
+  if (bottleneck) {
+    *bottleneck = best_bottleneck;
+  }
+  return best;
+}
+
+GlobalTransTopo incremental_tree(const GlobalTransTopo& current,
+                                 const AdjacencyList& overlay,
+                                 const AdjacencyListT<float>& bandwidth,
+                                 const TreeCostModel& model,
+                                 int max_depth,
+                                 int max_fanout,
+                                 int max_moves,
+                                 int* moves) {
+  // a move has to save this share of the time to be worth its disruption
+  constexpr double kMinGain = 0.01;
+  if (moves) {
+    *moves = 0;
+  }
+  auto linked = [&overlay](int u, int v) {
+    auto it = overlay.find(u);
+    return it != overlay.end() && std_isin(v, it->second);
+  };
+  ParentMap parent;
+  for (const auto& [id, topo] : current) {
+    if (overlay.count(id) == 0) {
+      return {};
+    }
+    if (topo.getType() == NodeTransTopo::Type::kRoot) {
+      parent[id] = 0;
+    } else if (linked(id, topo.getParent())) {
+      parent[id] = topo.getParent();
+    } else {
+      return {};
+    }
+  }
+  if (parent.empty()) {
+    return {};
+  }
+  auto cost = [&](const ParentMap& tree) {
+    return estimate_allreduce_time(
+        to_transtopo(tree), overlay, bandwidth, model);
+  };
+  // attach the new nodes, those next to none in the tree after the others
+  std::vector<int> joining;
+  for (const auto& [id, _] : overlay) {
+    if (parent.count(id) == 0) {
+      joining.push_back(id);
+    }
+  }
+  std::sort(joining.begin(), joining.end());
+  while (!joining.empty()) {
+    bool attached = false;
+    for (auto it = joining.begin(); it != joining.end();) {
+      int v = *it;
+      int best = 0;
+      double best_cost = 0;
+      for (int p : overlay.at(v)) {
+        if (parent.count(p) == 0) {
+          continue;
+        }
+        parent[v] = p;
+        if (within_bounds(parent, max_depth, max_fanout)) {
+          double c = cost(parent);
+          if (best == 0 || c < best_cost) {
+            best = p;
+            best_cost = c;
+          }
+        }
+        parent.erase(v);
+      }
+      if (best == 0) {
+        ++it;
+        continue;
+      }
+      parent[v] = best;
+      it = joining.erase(it);
+      attached = true;
+    }
+    if (!attached) {
+      return {};
+    }
+  }
+  // local moves: a node and its subtree under another neighbor
+  double now = cost(parent);
+  std::vector<int> nodes;
+  for (const auto& [v, _] : parent) {
+    nodes.push_back(v);
+  }
+  for (int m = 0; m < max_moves; ++m) {
+    int best_v = 0, best_p = 0;
+    double best_cost = now * (1 - kMinGain);
+    for (int v : nodes) {
+      int old = parent[v];
+      if (old == 0) {
+        continue;
+      }
+      for (int p : overlay.at(v)) {
+        if (p == old || parent.count(p) == 0 || in_subtree(parent, p, v)) {
+          continue;
+        }
+        parent[v] = p;
+        if (within_bounds(parent, max_depth, max_fanout)) {
+          double c = cost(parent);
+          if (c < best_cost) {
+            best_v = v;
+            best_p = p;
+            best_cost = c;
+          }
+        }
+        parent[v] = old;
+      }
+    }
+    if (best_v == 0) {
+      break;
+    }
+    parent[best_v] = best_p;
+    now = best_cost;
+    if (moves) {
+      ++*moves;
+    }
+  }
+  return to_transtopo(parent);
+}
+
 void dfs(const AdjacencyList& graph,
          int current,
          int target,
@@ -242,4 +772,161 @@ std::vector<TransPath> dijsktra_paths(AdjacencyList overlay,
   return result;
 }
 
+std::vector<TransPath> max_flow_paths(const AdjacencyList& overlay,
+                                      const AdjacencyListT<float>& capacity,
+                                      int target,
+                                      std::vector<float>* path_flows,
+                                      float* max_flow) {
+  // dense residual network, the super source is the last node and reaches
+  // every holder of the model
+  std::vector<int> ids;
+  std::unordered_map<int, int> index;
+  for (const auto& [node, _] : overlay) {
+    ids.push_back(node);
+  }
+  std::sort(ids.begin(), ids.end());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    index[ids[i]] = i;
+  }
+  if (index.count(target) == 0) {
+    throw std::runtime_error("The target is not in the overlay");
+  }
+  const int n = ids.size() + 1;
+  const int source = n - 1;
+  const int sink = index.at(target);
+  std::vector<std::vector<double>> cap(n, std::vector<double>(n, 0));
+  for (const auto& [u, neighbors] : overlay) {
+    const auto& caps = capacity.at(u);
+    for (size_t i = 0; i < neighbors.size(); ++i) {
+      auto it = index.find(neighbors[i]);
+      if (it != index.end() && caps[i] > 0) {
+        cap[index.at(u)][it->second] += caps[i];
+      }
+    }
+  }
+  for (int u = 0; u < source; ++u) {
+    if (u != sink) {
+      cap[source][u] = std::numeric_limits<double>::infinity();
+    }
+  }
+  auto residual = cap;
+  // Edmonds-Karp: shortest augmenting paths first
+  double total = 0;
+  while (true) {
+    std::vector<int> prev(n, -1);
+    prev[source] = source;
+    std::queue<int> q;
+    q.push(source);
+    while (!q.empty() && prev[sink] == -1) {
+      int u = q.front();
+      q.pop();
+      for (int v = 0; v < n; ++v) {
+        if (prev[v] == -1 && residual[u][v] > 1e-9) {
+          prev[v] = u;
+          q.push(v);
+        }
+      }
+    }
+    if (prev[sink] == -1) {
+      break;
+    }
+    double push = std::numeric_limits<double>::infinity();
+    for (int v = sink; v != source; v = prev[v]) {
+      push = std::min(push, residual[prev[v]][v]);
+    }
+    for (int v = sink; v != source; v = prev[v]) {
+      residual[prev[v]][v] -= push;
+      residual[v][prev[v]] += push;
+    }
+    total += push;
+  }
+  // decompose the net flow into paths, cancelling the cycles met on the way
+  std::vector<std::vector<double>> flow(n, std::vector<double>(n, 0));
+  for (int u = 0; u < n; ++u) {
+    for (int v = 0; v < n; ++v) {
+      double f = cap[u][v] - residual[u][v];
+      if (f > 0 && !std::isinf(f)) {
+        flow[u][v] = f;
+      }
+    }
+  }
+  for (int u = 0; u < source; ++u) {
+    for (int v = u + 1; v < source; ++v) {
+      double both = std::min(flow[u][v], flow[v][u]);
+      flow[u][v] -= both;
+      flow[v][u] -= both;
+    }
+  }
+  for (int u = 0; u < source; ++u) {
+    // the flow out of the super source is what leaves each holder
+    double out = 0, in = 0;
+    for (int v = 0; v < source; ++v) {
+      out += flow[u][v];
+      in += flow[v][u];
+    }
+    flow[source][u] = u == sink ? 0 : std::max(0.0, out - in);
+  }
+  const double eps = total * 1e-6;
+  std::vector<TransPath> paths;
+  std::vector<float> flows;
+  while (true) {
+    std::vector<int> walk = {source};
+    std::vector<int> pos(n, -1);
+    pos[source] = 0;
+    while (walk.back() != sink) {
+      int u = walk.back(), next = -1;
+      for (int v = 0; v < n; ++v) {
+        if (flow[u][v] > eps && (next == -1 || flow[u][v] > flow[u][next])) {
+          next = v;
+        }
+      }
+      if (next == -1) {
+        break;
+      }
+      if (pos[next] != -1) {
+        // a cycle, cancel it and walk on from where it started
+        double c = std::numeric_limits<double>::infinity();
+        for (size_t i = pos[next]; i < walk.size(); ++i) {
+          int a = walk[i], b = i + 1 < walk.size() ? walk[i + 1] : next;
+          c = std::min(c, flow[a][b]);
+        }
+        for (size_t i = pos[next]; i < walk.size(); ++i) {
+          int a = walk[i], b = i + 1 < walk.size() ? walk[i + 1] : next;
+          flow[a][b] -= c;
+        }
+        for (size_t i = pos[next] + 1; i < walk.size(); ++i) {
+          pos[walk[i]] = -1;
+        }
+        walk.resize(pos[next] + 1);
+        continue;
+      }
+      pos[next] = walk.size();
+      walk.push_back(next);
+    }
+    if (walk.back() != sink) {
+      break;
+    }
+    double f = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i + 1 < walk.size(); ++i) {
+      f = std::min(f, flow[walk[i]][walk[i + 1]]);
+    }
+    for (size_t i = 0; i + 1 < walk.size(); ++i) {
+      flow[walk[i]][walk[i + 1]] -= f;
+    }
+    std::vector<int> path;
+    for (size_t i = 1; i < walk.size(); ++i) {
+      path.push_back(ids[walk[i]]);
+    }
+    paths.emplace_back(std::move(path));
+    flows.push_back(f);
+  }
+  if (path_flows) {
+    path_flows->swap(flows);
+  }
+  if (max_flow) {
+    *max_flow = total;
+  }
+  return paths;
+}
+
 }  // namespace constellation::algorithm::basic
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "constellation_commons.h"
 #include "./algorithm_helper.h"
 
+#include <functional>
+
 namespace constellation::algorithm::basic {
 
 /* brief: Generate a transport topology tree using DFS
@@ -17,6 +19,126 @@ GlobalTransTopo dfs_tree(const AdjacencyList& overlay);
  */
 GlobalTransTopo random_choose_tree(const AdjacencyList& overlay);
 
+/* brief: Let the root and those of its children of a transport topology
+ * tree that are pairwise overlay neighbours reduce-scatter and all-gather
+ * among themselves, see NodeTransTopo::scatter_group. The children are
+ * taken greedily, the ones linked to the most other children first.
+ * @param transtopo: the transport topology tree, the group is set on its
+ * members and cleared on the other nodes
+ * @param overlay: the overlay topology
+ * @param linkable: if set, whether two members may share segments over
+ * their link besides being overlay neighbours
+ * @return the group, the root first. Empty if it would be the root alone
+ */
+std::vector<int> set_scatter_group(
+    GlobalTransTopo& transtopo,
+    const AdjacencyList& overlay,
+    const std::function<bool(int, int)>& linkable = nullptr);
+
+/* brief: Pack spanning trees into the overlay greedily. Each tree is a
+ * maximum spanning tree of the capacity the trees before it left, and takes
+ * its bottleneck capacity from every edge it uses. With unit capacities the
+ * trees are edge-disjoint.
+ * @param overlay: the overlay topology
+ * @param capacity: the capacity of each edge, in the order of overlay. The
+ * smaller direction counts for both
+ * @param max_trees: the maximum number of trees
+ * @param bottlenecks: set to the bottleneck capacity of each tree
+ * @return the trees, each rooted at its center
+ */
+std::vector<GlobalTransTopo> pack_spanning_trees(
+    const AdjacencyList& overlay,
+    const AdjacencyListT<float>& capacity,
+    size_t max_trees,
+    std::vector<float>* bottlenecks = nullptr);
+
+/* brief: The bottleneck capacity of a transport topology tree, and the
+ * capacity it leaves once it takes that from every edge it uses, as in
+ * pack_spanning_trees.
+ * @param tree: the tree, over links of overlay
+ * @param overlay: the overlay topology
+ * @param capacity: the capacity of each edge, in the order of overlay. The
+ * smaller direction counts for both
+ * @param left: if not null, set to the capacity left, in the order of overlay
+ * @return the bottleneck, 0 if the tree has no edge
+ */
+float take_tree_capacity(const GlobalTransTopo& tree,
+                         const AdjacencyList& overlay,
+                         const AdjacencyListT<float>& capacity,
+                         AdjacencyListT<float>* left = nullptr);
+
+/* brief: What an all-reduce over a transport topology tree costs */
+struct TreeCostModel {
+  /* the size of the model in bytes */
+  uint64_t bytes = 0;
+  /* the latency of a message over an edge in seconds */
+  double latency = 0;
+  /* the bytes a node sums per second, 0 if summing is free */
+  double reduce_rate = 0;
+};
+
+/* brief: Estimate the time of an all-reduce over a transport topology tree.
+ * The children of a node share its link: it receives them one after another
+ * as they are done and sums each, then sends the result down one child after
+ * another.
+ * @param transtopo: the transport topology tree
+ * @param overlay: the overlay topology
+ * @param bandwidth: the bandwidth of each edge in Mbps, in the order of
+ * overlay. The smaller direction counts for both
+ * @param model: the cost model
+ * @return the time in seconds
+ */
+double estimate_allreduce_time(const GlobalTransTopo& transtopo,
+                               const AdjacencyList& overlay,
+                               const AdjacencyListT<float>& bandwidth,
+                               const TreeCostModel& model);
+
+/* brief: Build the transport topology tree of the widest bottleneck edge.
+ * From every root a tree is grown over the widest edge that keeps the
+ * bounds (Prim's algorithm), the one of the widest bottleneck wins, then
+ * the one of the least estimate_allreduce_time.
+ * @param overlay: the overlay topology
+ * @param bandwidth: the bandwidth of each edge in Mbps, in the order of
+ * overlay. The smaller direction counts for both
+ * @param max_depth: the maximum depth of a node, 0 for no bound
+ * @param max_fanout: the maximum number of children of a node, 0 for no bound
+ * @param model: the cost model of estimate_allreduce_time
+ * @param bottleneck: set to the bandwidth of the bottleneck edge
+ * @return the tree, empty if no tree keeps the bounds
+ */
+GlobalTransTopo max_bottleneck_tree(const AdjacencyList& overlay,
+                                    const AdjacencyListT<float>& bandwidth,
+                                    int max_depth,
+                                    int max_fanout,
+                                    const TreeCostModel& model,
+                                    float* bottleneck = nullptr);
+
+/* brief: Extend a transport topology tree to the nodes that joined the
+ * overlay instead of building a new one, so few nodes change their links.
+ * Each new node is attached where the tree costs the least, then up to
+ * max_moves times the node whose move to another parent (with its subtree)
+ * saves the most is moved, while that saves at least 1% of the time.
+ * @param current: the tree so far
+ * @param overlay: the overlay topology
+ * @param bandwidth: the bandwidth of each edge in Mbps, in the order of
+ * overlay. The smaller direction counts for both
+ * @param model: the cost model of estimate_allreduce_time
+ * @param max_depth: the maximum depth of a node, 0 for no bound
+ * @param max_fanout: the maximum number of children of a node, 0 for no bound
+ * @param max_moves: the maximum number of nodes moved
+ * @param moves: set to the number of nodes moved
+ * @return the tree, empty if `current` is empty, has a node or an edge that
+ * is not in the overlay any more, or cannot take the new nodes
+ */
+GlobalTransTopo incremental_tree(const GlobalTransTopo& current,
+                                 const AdjacencyList& overlay,
+                                 const AdjacencyListT<float>& bandwidth,
+                                 const TreeCostModel& model,
+                                 int max_depth,
+                                 int max_fanout,
+                                 int max_moves,
+                                 int* moves = nullptr);
+
 /* brief: Generate  model synchronization paths to target node randomly
  * @param overlay: the overlay topology
  * @param target: the target node
@@ -39,4 +161,23 @@ std::vector<TransPath> dijsktra_paths(
     int target,
     std::vector<float>* path_weights = nullptr);
 
+/* brief: Plan the migration of the model to the target as a maximum flow
+ * from all other nodes, which hold the model, over the overlay. Each path
+ * carries the share of the model of its flow, so all paths finish together
+ * in bytes / max_flow, the least time any split over the overlay can take
+ * (with the paths pipelined, see PlanMigrateChunks).
+ * @param overlay: the overlay topology
+ * @param capacity: the bandwidth of each edge, in the order of overlay. Each
+ * direction of an edge is used on its own (full duplex)
+ * @param target: the target node
+ * @param path_flows: set to the flow of each path
+ * @param max_flow: set to the total flow
+ * @return the model synchronization paths, each from a source to the target
+ */
+std::vector<TransPath> max_flow_paths(const AdjacencyList& overlay,
+                                      const AdjacencyListT<float>& capacity,
+                                      int target,
+                                      std::vector<float>* path_flows = nullptr,
+                                      float* max_flow = nullptr);
+
 }  // namespace constellation::algorithm::basic
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "compressor.h"
+#include "fp16_compressor.h"
+#include "powersgd_compressor.h"
+#include "quantize_compressor.h"
+#include "topk_compressor.h"
+#include "../trainer/reducer.h"
+
+#include "dmlc/logging.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace constellation {
+
+void Compressor::Compress(const CArray& src, CArray* dst) {
+  CHECK_EQ(src.dtype, static_cast<int>(ConstelDataType::CONSTEL_FLOAT32))
+      << "only float32 can be compressed";
+  size_t num = src.size() / sizeof(float);
+  size_t size = sizeof(CompressedHeader) + PayloadSize(num);
+  if (dst->isNone() || dst->size() != size) {
+    *dst = CArray(size, src.dtype);
+  }
+  dst->dtype = src.dtype;
+  CompressedHeader header{kMagic, kind(), num};
+  std::memcpy(dst->data(), &header, sizeof(header));
+  char* payload = dst->data() + sizeof(header);
+  if (!error_feedback_) {
+    CompressPayload(reinterpret_cast<const float*>(src.data()), num, payload);
+    return;
+  }
+
+  if (residual_.size() != src.size()) {
+    residual_ = CArray(src.size(), src.dtype);
+    std::memset(residual_.data(), 0, residual_.size());
+    corrected_ = CArray(src.size(), src.dtype);
+    decoded_ = CArray(src.size(), src.dtype);
+  }
+  auto* residual = reinterpret_cast<float*>(residual_.data());
+  auto* corrected = reinterpret_cast<float*>(corrected_.data());
+  auto* decoded = reinterpret_cast<float*>(decoded_.data());
+  reducer::Sum(corrected, src.data(), residual, src.size(), src.dtype);
+  CompressPayload(corrected, num, payload);
+  DecompressPayload(payload, num, decoded);
+  for (size_t i = 0; i < num; ++i) {
+    residual[i] = corrected[i] - decoded[i];
+  }
+}
+
+size_t Compressor::DecompressedSize(const CArray& src) {
+  CHECK_GE(src.size(), sizeof(CompressedHeader));
+  CompressedHeader header;
+  std::memcpy(&header, src.data(), sizeof(header));
+  CHECK_EQ(header.magic, kMagic) << "not a compressed buffer";
+  return header.num * sizeof(float);
+}
+
+void Compressor::Decompress(const CArray& src, CArray* dst) const {
+  size_t size = DecompressedSize(src);
+  CompressedHeader header;
+  std::memcpy(&header, src.data(), sizeof(header));
+  CHECK_EQ(header.kind, kind())
+      << "buffer was compressed by another compressor than " << name()
+      << ", all nodes must use the same CONSTEL_COMPRESSOR";
+  CHECK_EQ(src.size(), sizeof(header) + PayloadSize(header.num));
+  int dtype = static_cast<int>(ConstelDataType::CONSTEL_FLOAT32);
+  if (dst->isNone() || dst->size() != size) {
+    *dst = CArray(size, dtype);
+  }
+  dst->dtype = dtype;
+  DecompressPayload(src.data() + sizeof(header),
+                    header.num,
+                    reinterpret_cast<float*>(dst->data()));
+}
+
+std::unique_ptr<Compressor> CompressorFactory::CreateCompressor(
+    const std::string& spec,
+    bool error_feedback) {
+  if (spec.empty() || spec == "none") {
+    return nullptr;
+  }
+  auto pos = spec.find(':');
+  std::string name = spec.substr(0, pos);
+  std::string param = pos == std::string::npos ? "" : spec.substr(pos + 1);
+  const auto& it = GetCompressorMap().find(name);
+  if (it == GetCompressorMap().end()) {
+    throw std::runtime_error("Unknown compressor name: " + name);
+  }
+  return std::unique_ptr<Compressor>(it->second(param, error_feedback));
+}
+
+const std::unordered_map<std::string, CompressorFactory::CompressorCreator>&
+CompressorFactory::GetCompressorMap() {
+  static const std::unordered_map<std::string, CompressorCreator> map = {
+      {"fp16",
+       [](const std::string&, bool ef) { return new FP16Compressor(ef); }},
+      {"quantize",
+       [](const std::string& param, bool ef) {
+         int bits = param.empty() ? 8 : std::stoi(param);
+         return new QuantizeCompressor(bits, ef);
+       }},
+      {"topk",
+       [](const std::string& param, bool ef) {
+         double ratio = param.empty() ? 0.01 : std::stod(param);
+         return new TopKCompressor(ratio, ef);
+       }},
+      {"powersgd",
+       [](const std::string& param, bool ef) {
+         int rank = param.empty() ? 4 : std::stoi(param);
+         return new PowerSGDCompressor(rank, ef);
+       }},
+  };
+  return map;
+}
+
+}  // namespace constellation
@@ -0,0 +1,100 @@
+#ifndef CONSTELLATION_COMPRESSOR_H_
+#define CONSTELLATION_COMPRESSOR_H_
+
+#include "internal/CArray.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace constellation {
+
+/**
+ * \brief lossy compression of float32 gradients for kCompressedPushPull.
+ *
+ * A compressed buffer is a CompressedHeader followed by the payload of the
+ * concrete compressor. Decompress only depends on the buffer, so any instance
+ * of the same kind can decode it; Compress may keep state (random generator,
+ * warm start, residual), so every key and direction owns its own instance.
+ *
+ * With error feedback, what a compression loses is kept in a per-key residual
+ * and added to the next gradient of the key, so nothing is dropped for good.
+ */
+class Compressor {
+ public:
+  struct CompressedHeader {
+    uint32_t magic;
+    uint32_t kind;
+    /** \brief number of float32 elements */
+    uint64_t num;
+  };
+
+  static constexpr uint32_t kMagic = 0x4C545343;  // "CSTL"
+
+  explicit Compressor(bool error_feedback) : error_feedback_(error_feedback) {}
+  virtual ~Compressor() = default;
+
+  /** \brief compress the float32 buffer `src` into `dst`, resized to fit */
+  void Compress(const CArray& src, CArray* dst);
+
+  /**
+   * \brief decompress `src` into `dst`. `dst` is reallocated unless it
+   * already has DecompressedSize(src) bytes.
+   */
+  void Decompress(const CArray& src, CArray* dst) const;
+
+  /** \brief bytes of the float32 buffer `src` was compressed from */
+  static size_t DecompressedSize(const CArray& src);
+
+  bool error_feedback() const {
+    return error_feedback_;
+  }
+
+  virtual const char* name() const = 0;
+
+ protected:
+  /** \brief identifies the payload format, checked when decompressing */
+  virtual uint32_t kind() const = 0;
+  /** \brief payload bytes for `num` elements */
+  virtual size_t PayloadSize(size_t num) const = 0;
+  virtual void CompressPayload(const float* src, size_t num, char* dst) = 0;
+  virtual void DecompressPayload(const char* src,
+                                 size_t num,
+                                 float* dst) const = 0;
+
+ private:
+  bool error_feedback_;
+  /** \brief gradient error not sent yet */
+  CArray residual_;
+  /** \brief gradient plus residual, and its decompressed value */
+  CArray corrected_;
+  CArray decoded_;
+};
+
+/**
+ * \brief creates compressors from a spec "name[:param]":
+ *  - fp16: cast to half
+ *  - quantize:bits: stochastic quantization to 8 (default) or 4 bits
+ *  - topk:ratio: the largest `ratio` (default 0.01) of the elements
+ *  - powersgd:rank: rank `rank` (default 4) approximation
+ */
+class CompressorFactory {
+ public:
+  using CompressorCreator =
+      std::function<Compressor*(const std::string& param, bool ef)>;
+
+  /** \brief nullptr for an empty spec or "none" */
+  static std::unique_ptr<Compressor> CreateCompressor(const std::string& spec,
+                                                      bool error_feedback);
+
+ private:
+  static const std::unordered_map<std::string, CompressorCreator>&
+  GetCompressorMap();
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_COMPRESSOR_H_
@@ -0,0 +1,31 @@
+#include "fp16_compressor.h"
+#include "../trainer/reducer.h"
+
+#include <cstring>
+
+namespace constellation {
+
+size_t FP16Compressor::PayloadSize(size_t num) const {
+  return num * sizeof(uint16_t);
+}
+
+void FP16Compressor::CompressPayload(const float* src,
+                                     size_t num,
+                                     char* dst) {
+  for (size_t i = 0; i < num; ++i) {
+    uint16_t h = reducer::FloatToHalf(src[i]);
+    std::memcpy(dst + i * sizeof(h), &h, sizeof(h));
+  }
+}
+
+void FP16Compressor::DecompressPayload(const char* src,
+                                       size_t num,
+                                       float* dst) const {
+  for (size_t i = 0; i < num; ++i) {
+    uint16_t h;
+    std::memcpy(&h, src + i * sizeof(h), sizeof(h));
+    dst[i] = reducer::HalfToFloat(h);
+  }
+}
+
+}  // namespace constellation
@@ -0,0 +1,32 @@
+#ifndef CONSTELLATION_FP16_COMPRESSOR_H_
+#define CONSTELLATION_FP16_COMPRESSOR_H_
+
+#include "compressor.h"
+
+namespace constellation {
+
+/**
+ * \brief casts every element to IEEE half, halving the bytes on the wire
+ */
+class FP16Compressor : public Compressor {
+ public:
+  explicit FP16Compressor(bool error_feedback) : Compressor(error_feedback) {}
+
+  const char* name() const override {
+    return "fp16";
+  }
+
+ protected:
+  uint32_t kind() const override {
+    return 1;
+  }
+  size_t PayloadSize(size_t num) const override;
+  void CompressPayload(const float* src, size_t num, char* dst) override;
+  void DecompressPayload(const char* src,
+                         size_t num,
+                         float* dst) const override;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_FP16_COMPRESSOR_H_
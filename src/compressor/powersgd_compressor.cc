@@ -0,0 +1,130 @@
+#include "powersgd_compressor.h"
+
+#include "dmlc/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace constellation {
+
+PowerSGDCompressor::PowerSGDCompressor(int rank, bool error_feedback)
+    : Compressor(error_feedback), rank_(rank) {
+  CHECK_GT(rank, 0) << "powersgd rank must be positive";
+}
+
+void PowerSGDCompressor::MatrixShape(size_t num, size_t* rows, size_t* cols) {
+  if (num == 0) {
+    *rows = *cols = 0;
+    return;
+  }
+  *rows = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(num))));
+  *cols = (num + *rows - 1) / *rows;
+}
+
+size_t PowerSGDCompressor::Rank(size_t num) const {
+  size_t rows, cols;
+  MatrixShape(num, &rows, &cols);
+  return std::min(rank_, std::min(rows, cols));
+}
+
+size_t PowerSGDCompressor::PayloadSize(size_t num) const {
+  size_t rows, cols;
+  MatrixShape(num, &rows, &cols);
+  return (rows + cols) * Rank(num) * sizeof(float);
+}
+
+void PowerSGDCompressor::CompressPayload(const float* src,
+                                         size_t num,
+                                         char* dst) {
+  size_t rows, cols;
+  MatrixShape(num, &rows, &cols);
+  size_t r = Rank(num);
+  if (q_.size() != cols * r) {
+    // fixed pseudo random start, then warm started from the last Q
+    q_.resize(cols * r);
+    uint32_t state = 0x2545F491u;
+    for (auto& v : q_) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      v = (state >> 8) * (2.0f / (1 << 24)) - 1.0f;
+    }
+  }
+  // P = M Q
+  p_.assign(rows * r, 0.0f);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t c = 0; c < cols; ++c) {
+      size_t idx = i * cols + c;
+      if (idx >= num)
+        break;
+      float m = src[idx];
+      for (size_t j = 0; j < r; ++j) {
+        p_[i * r + j] += m * q_[c * r + j];
+      }
+    }
+  }
+  // orthonormalize the columns of P (modified Gram-Schmidt)
+  for (size_t j = 0; j < r; ++j) {
+    for (size_t k = 0; k < j; ++k) {
+      double dot = 0;
+      for (size_t i = 0; i < rows; ++i) {
+        dot += p_[i * r + j] * p_[i * r + k];
+      }
+      for (size_t i = 0; i < rows; ++i) {
+        p_[i * r + j] -= static_cast<float>(dot) * p_[i * r + k];
+      }
+    }
+    double norm = 0;
+    for (size_t i = 0; i < rows; ++i) {
+      norm += p_[i * r + j] * p_[i * r + j];
+    }
+    norm = std::sqrt(norm);
+    float inv = norm > 1e-12 ? static_cast<float>(1.0 / norm) : 0.0f;
+    for (size_t i = 0; i < rows; ++i) {
+      p_[i * r + j] *= inv;
+    }
+  }
+  // Q = M^T P
+  std::fill(q_.begin(), q_.end(), 0.0f);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t c = 0; c < cols; ++c) {
+      size_t idx = i * cols + c;
+      if (idx >= num)
+        break;
+      float m = src[idx];
+      for (size_t j = 0; j < r; ++j) {
+        q_[c * r + j] += m * p_[i * r + j];
+      }
+    }
+  }
+  std::memcpy(dst, p_.data(), p_.size() * sizeof(float));
+  std::memcpy(dst + p_.size() * sizeof(float),
+              q_.data(),
+              q_.size() * sizeof(float));
+}
+
+void PowerSGDCompressor::DecompressPayload(const char* src,
+                                           size_t num,
+                                           float* dst) const {
+  size_t rows, cols;
+  MatrixShape(num, &rows, &cols);
+  size_t r = Rank(num);
+  std::vector<float> p(rows * r), q(cols * r);
+  std::memcpy(p.data(), src, p.size() * sizeof(float));
+  std::memcpy(q.data(), src + p.size() * sizeof(float), q.size() * sizeof(float));
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t c = 0; c < cols; ++c) {
+      size_t idx = i * cols + c;
+      if (idx >= num)
+        break;
+      float v = 0;
+      for (size_t j = 0; j < r; ++j) {
+        v += p[i * r + j] * q[c * r + j];
+      }
+      dst[idx] = v;
+    }
+  }
+}
+
+}  // namespace constellation
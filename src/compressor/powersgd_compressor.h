@@ -0,0 +1,51 @@
+#ifndef CONSTELLATION_POWERSGD_COMPRESSOR_H_
+#define CONSTELLATION_POWERSGD_COMPRESSOR_H_
+
+#include "compressor.h"
+
+#include <vector>
+
+namespace constellation {
+
+/**
+ * \brief rank-r approximation by one step of power iteration (PowerSGD).
+ *
+ * The gradient is viewed as a rows x cols matrix M, about square and padded
+ * with zeros. P = M Q is orthonormalized and Q = M^T P, then P and Q are sent
+ * and decode to P Q^T. Q is kept and reused as the start of the next
+ * iteration. Meant to be used with error feedback.
+ */
+class PowerSGDCompressor : public Compressor {
+ public:
+  PowerSGDCompressor(int rank, bool error_feedback);
+
+  const char* name() const override {
+    return "powersgd";
+  }
+
+  /** \brief the matrix a gradient of `num` elements is viewed as */
+  static void MatrixShape(size_t num, size_t* rows, size_t* cols);
+
+ protected:
+  uint32_t kind() const override {
+    return 4;
+  }
+  size_t PayloadSize(size_t num) const override;
+  void CompressPayload(const float* src, size_t num, char* dst) override;
+  void DecompressPayload(const char* src,
+                         size_t num,
+                         float* dst) const override;
+
+ private:
+  /** \brief the rank used for `num` elements, never above the matrix size */
+  size_t Rank(size_t num) const;
+
+  size_t rank_;
+  /** \brief cols x rank, warm start of the power iteration */
+  std::vector<float> q_;
+  std::vector<float> p_;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_POWERSGD_COMPRESSOR_H_
@@ -0,0 +1,92 @@
+#include "quantize_compressor.h"
+
+#include "dmlc/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace constellation {
+
+QuantizeCompressor::QuantizeCompressor(int bits, bool error_feedback)
+    : Compressor(error_feedback), bits_(bits), levels_((1 << (bits - 1)) - 1) {
+  CHECK(bits == 8 || bits == 4) << "quantize only supports 8 or 4 bits";
+}
+
+size_t QuantizeCompressor::PayloadSize(size_t num) const {
+  size_t num_blocks = (num + kBlockSize - 1) / kBlockSize;
+  size_t code_bytes = bits_ == 8 ? num : (num + 1) / 2;
+  return num_blocks * sizeof(float) + code_bytes;
+}
+
+float QuantizeCompressor::NextUniform() {
+  // xorshift32, plenty for rounding
+  rng_state_ ^= rng_state_ << 13;
+  rng_state_ ^= rng_state_ >> 17;
+  rng_state_ ^= rng_state_ << 5;
+  return (rng_state_ >> 8) * (1.0f / (1 << 24));
+}
+
+void QuantizeCompressor::CompressPayload(const float* src,
+                                         size_t num,
+                                         char* dst) {
+  size_t num_blocks = (num + kBlockSize - 1) / kBlockSize;
+  char* scales = dst;
+  auto* codes = reinterpret_cast<uint8_t*>(dst + num_blocks * sizeof(float));
+  if (bits_ == 4) {
+    std::memset(codes, 0, (num + 1) / 2);
+  }
+  for (size_t b = 0; b < num_blocks; ++b) {
+    size_t begin = b * kBlockSize;
+    size_t end = std::min(num, begin + kBlockSize);
+    float scale = 0;
+    for (size_t i = begin; i < end; ++i) {
+      scale = std::max(scale, std::fabs(src[i]));
+    }
+    std::memcpy(scales + b * sizeof(float), &scale, sizeof(scale));
+    float factor = scale > 0 ? levels_ / scale : 0;
+    for (size_t i = begin; i < end; ++i) {
+      float level = std::fabs(src[i]) * factor;
+      int q = static_cast<int>(level);
+      if (NextUniform() < level - q) {
+        q++;
+      }
+      q = std::min(q, levels_);
+      if (src[i] < 0) {
+        q = -q;
+      }
+      if (bits_ == 8) {
+        codes[i] = static_cast<uint8_t>(static_cast<int8_t>(q));
+      } else {
+        // biased by 8 into a nibble
+        codes[i / 2] |= static_cast<uint8_t>(q + 8) << ((i % 2) * 4);
+      }
+    }
+  }
+}
+
+void QuantizeCompressor::DecompressPayload(const char* src,
+                                           size_t num,
+                                           float* dst) const {
+  size_t num_blocks = (num + kBlockSize - 1) / kBlockSize;
+  const auto* codes =
+      reinterpret_cast<const uint8_t*>(src + num_blocks * sizeof(float));
+  for (size_t b = 0; b < num_blocks; ++b) {
+    float scale;
+    std::memcpy(&scale, src + b * sizeof(float), sizeof(scale));
+    float unit = scale / levels_;
+    size_t begin = b * kBlockSize;
+    size_t end = std::min(num, begin + kBlockSize);
+    for (size_t i = begin; i < end; ++i) {
+      int q;
+      if (bits_ == 8) {
+        q = static_cast<int8_t>(codes[i]);
+      } else {
+        q = static_cast<int>((codes[i / 2] >> ((i % 2) * 4)) & 0xF) - 8;
+      }
+      dst[i] = q * unit;
+    }
+  }
+}
+
+}  // namespace constellation
@@ -0,0 +1,47 @@
+#ifndef CONSTELLATION_QUANTIZE_COMPRESSOR_H_
+#define CONSTELLATION_QUANTIZE_COMPRESSOR_H_
+
+#include "compressor.h"
+
+namespace constellation {
+
+/**
+ * \brief stochastic quantization to 8 or 4 bits (QSGD style).
+ *
+ * Elements are scaled by the largest magnitude of their block of kBlockSize
+ * and rounded up or down at random, so the decoded value is unbiased. Four
+ * bits are packed two per byte.
+ */
+class QuantizeCompressor : public Compressor {
+ public:
+  QuantizeCompressor(int bits, bool error_feedback);
+
+  const char* name() const override {
+    return "quantize";
+  }
+
+  static constexpr size_t kBlockSize = 256;
+
+ protected:
+  uint32_t kind() const override {
+    return 8 + bits_;
+  }
+  size_t PayloadSize(size_t num) const override;
+  void CompressPayload(const float* src, size_t num, char* dst) override;
+  void DecompressPayload(const char* src,
+                         size_t num,
+                         float* dst) const override;
+
+ private:
+  /** \brief uniform in [0, 1) */
+  float NextUniform();
+
+  int bits_;
+  /** \brief largest quantized magnitude */
+  int levels_;
+  uint32_t rng_state_ = 0x9E3779B9u;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_QUANTIZE_COMPRESSOR_H_
@@ -0,0 +1,64 @@
+#include "topk_compressor.h"
+
+#include "dmlc/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace constellation {
+
+TopKCompressor::TopKCompressor(double ratio, bool error_feedback)
+    : Compressor(error_feedback), ratio_(ratio) {
+  CHECK(ratio > 0 && ratio <= 1) << "topk ratio must be in (0, 1]";
+}
+
+size_t TopKCompressor::NumKept(size_t num) const {
+  if (num == 0) {
+    return 0;
+  }
+  auto k = static_cast<size_t>(std::ceil(num * ratio_));
+  return std::min(num, std::max<size_t>(k, 1));
+}
+
+size_t TopKCompressor::PayloadSize(size_t num) const {
+  return NumKept(num) * (sizeof(uint32_t) + sizeof(float));
+}
+
+void TopKCompressor::CompressPayload(const float* src,
+                                     size_t num,
+                                     char* dst) {
+  size_t k = NumKept(num);
+  indices_.resize(num);
+  std::iota(indices_.begin(), indices_.end(), 0);
+  std::nth_element(indices_.begin(),
+                   indices_.begin() + k,
+                   indices_.end(),
+                   [src](uint32_t a, uint32_t b) {
+                     return std::fabs(src[a]) > std::fabs(src[b]);
+                   });
+  // in index order, so decoding writes memory sequentially
+  std::sort(indices_.begin(), indices_.begin() + k);
+  char* values = dst + k * sizeof(uint32_t);
+  for (size_t i = 0; i < k; ++i) {
+    std::memcpy(dst + i * sizeof(uint32_t), &indices_[i], sizeof(uint32_t));
+    std::memcpy(values + i * sizeof(float), &src[indices_[i]], sizeof(float));
+  }
+}
+
+void TopKCompressor::DecompressPayload(const char* src,
+                                       size_t num,
+                                       float* dst) const {
+  size_t k = NumKept(num);
+  std::fill(dst, dst + num, 0.0f);
+  const char* values = src + k * sizeof(uint32_t);
+  for (size_t i = 0; i < k; ++i) {
+    uint32_t index;
+    std::memcpy(&index, src + i * sizeof(uint32_t), sizeof(index));
+    CHECK_LT(index, num);
+    std::memcpy(&dst[index], values + i * sizeof(float), sizeof(float));
+  }
+}
+
+}  // namespace constellation
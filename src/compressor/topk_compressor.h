@@ -0,0 +1,42 @@
+#ifndef CONSTELLATION_TOPK_COMPRESSOR_H_
+#define CONSTELLATION_TOPK_COMPRESSOR_H_
+
+#include "compressor.h"
+
+#include <vector>
+
+namespace constellation {
+
+/**
+ * \brief keeps the `ratio` largest elements by magnitude as (index, value)
+ * pairs, the rest decode to zero. Meant to be used with error feedback.
+ */
+class TopKCompressor : public Compressor {
+ public:
+  TopKCompressor(double ratio, bool error_feedback);
+
+  const char* name() const override {
+    return "topk";
+  }
+
+ protected:
+  uint32_t kind() const override {
+    return 3;
+  }
+  size_t PayloadSize(size_t num) const override;
+  void CompressPayload(const float* src, size_t num, char* dst) override;
+  void DecompressPayload(const char* src,
+                         size_t num,
+                         float* dst) const override;
+
+ private:
+  /** \brief number of elements kept out of `num` */
+  size_t NumKept(size_t num) const;
+
+  double ratio_;
+  std::vector<uint32_t> indices_;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_TOPK_COMPRESSOR_H_
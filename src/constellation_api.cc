@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -55,6 +56,18 @@ int ConstellationTrainerPushPull(ConstelTrainerHandle handle,
                                  const int* keys_out,
                                  ConstellationCArrayHandle* values,
                                  ConstellationCArrayHandle* outs) {
+  return ConstellationTrainerPushPullWithPriority(
+      handle, key_num, keys_in, key_num_out, keys_out, values, outs, nullptr);
+}
+
+int ConstellationTrainerPushPullWithPriority(ConstelTrainerHandle handle,
+                                             uint32_t key_num,
+                                             const int* keys_in,
+                                             uint32_t key_num_out,
+                                             const int* keys_out,
+                                             ConstellationCArrayHandle* values,
+                                             ConstellationCArrayHandle* outs,
+                                             const int* priorities) {
   API_BEGIN();
   std::vector<int> keys_in_vec(keys_in, keys_in + key_num);
   std::vector<int> keys_out_vec(keys_out, keys_out + key_num_out);
@@ -69,9 +82,104 @@ int ConstellationTrainerPushPull(ConstelTrainerHandle handle,
   for (uint32_t i = 0; i < key_num_out; ++i) {
     outs_vec[i] = static_cast<CArray*>(outs[i]);
   }
+  std::vector<int> priorities_vec;
+  if (priorities) {
+    priorities_vec.assign(priorities, priorities + key_num);
+  }
   static_cast<ConstelTrainer*>(handle)->PushPull(
-      keys_in_vec, values_vec, outs_vec);
+      keys_in_vec, values_vec, outs_vec, priorities_vec);
+
+  API_END();
+}
 
+int ConstellationTrainerPushPullAsync(ConstelTrainerHandle handle,
+                                      uint32_t key_num,
+                                      const int* keys_in,
+                                      uint32_t key_num_out,
+                                      const int* keys_out,
+                                      ConstellationCArrayHandle* values,
+                                      ConstellationCArrayHandle* outs,
+                                      const int* priorities,
+                                      ConstellationPushPullHandle* out) {
+  API_BEGIN();
+  std::vector<int> keys_in_vec(keys_in, keys_in + key_num);
+  std::vector<int> keys_out_vec(keys_out, keys_out + key_num_out);
+  if (keys_in_vec.size() != keys_out_vec.size()) {
+    throw std::runtime_error("Have different size of keys_in and keys_out");
+  }
+  std::vector<CArray> values_vec(keys_in_vec.size());
+  std::vector<CArray*> outs_vec(keys_out_vec.size());
+  for (uint32_t i = 0; i < key_num; ++i) {
+    values_vec[i] = *static_cast<CArray*>(values[i]);
+  }
+  for (uint32_t i = 0; i < key_num_out; ++i) {
+    outs_vec[i] = static_cast<CArray*>(outs[i]);
+  }
+  std::vector<int> priorities_vec;
+  if (priorities) {
+    priorities_vec.assign(priorities, priorities + key_num);
+  }
+  auto pushpull = static_cast<ConstelTrainer*>(handle)->PushPullAsync(
+      keys_in_vec, values_vec, outs_vec, priorities_vec);
+  *out = new std::shared_ptr<PushPullHandle>(std::move(pushpull));
+  API_END();
+}
+
+int ConstellationTrainerPushPullRowSparse(ConstelTrainerHandle handle,
+                                          uint32_t key_num,
+                                          const int* keys,
+                                          const uint64_t* num_rows,
+                                          const uint64_t* row_ids,
+                                          ConstellationCArrayHandle* values,
+                                          const uint64_t* max_rows_out,
+                                          uint64_t* num_rows_out,
+                                          uint64_t* row_ids_out,
+                                          ConstellationCArrayHandle* outs) {
+  API_BEGIN();
+  std::vector<int> keys_vec(keys, keys + key_num);
+  std::vector<std::vector<uint64_t>> row_ids_vec(key_num);
+  std::vector<CArray> values_vec(key_num);
+  for (uint32_t i = 0; i < key_num; ++i) {
+    row_ids_vec[i].assign(row_ids, row_ids + num_rows[i]);
+    row_ids += num_rows[i];
+    values_vec[i] = *static_cast<CArray*>(values[i]);
+  }
+  std::vector<std::vector<uint64_t>> row_ids_pull;
+  std::vector<CArray> vals_pull;
+  static_cast<ConstelTrainer*>(handle)->PushPullRowSparse(
+      keys_vec, row_ids_vec, values_vec, &row_ids_pull, &vals_pull);
+  for (uint32_t i = 0; i < key_num; ++i) {
+    const auto& ids = row_ids_pull[i];
+    if (ids.size() > max_rows_out[i]) {
+      throw std::runtime_error("Pulled " + std::to_string(ids.size()) +
+                               " rows of key " + std::to_string(keys[i]) +
+                               ", more than max_rows_out");
+    }
+    num_rows_out[i] = ids.size();
+    std::copy(ids.begin(), ids.end(), row_ids_out);
+    row_ids_out += max_rows_out[i];
+    static_cast<CArray*>(outs[i])->CopyFrom(vals_pull[i].data(),
+                                            vals_pull[i].size());
+  }
+  API_END();
+}
+
+int ConstellationPushPullHandleWait(ConstellationPushPullHandle handle) {
+  API_BEGIN();
+  (*static_cast<std::shared_ptr<PushPullHandle>*>(handle))->Wait();
+  API_END();
+}
+
+int ConstellationPushPullHandlePoll(ConstellationPushPullHandle handle,
+                                    int* done) {
+  API_BEGIN();
+  *done = (*static_cast<std::shared_ptr<PushPullHandle>*>(handle))->Poll();
+  API_END();
+}
+
+int ConstellationPushPullHandleFree(ConstellationPushPullHandle handle) {
+  API_BEGIN();
+  delete static_cast<std::shared_ptr<PushPullHandle>*>(handle);
   API_END();
 }
 
@@ -28,6 +28,9 @@ ConstelController::ConstelController() {
 
   batch_t_window_ = std::make_shared<WindowedBuffer<int64_t>>(5);
   rtt_window_ = std::make_shared<WindowedBuffer<int64_t>>(5);
+  int64_t lead_steps = get_env("CONSTEL_MIGRATE_LEAD_STEPS", 0);
+  CHECK_GE(lead_steps, 0);
+  migrate_lead_steps_ = lead_steps;
 
   // create node manager
 #ifdef CONS_NETWORK_AWARE
@@ -141,15 +144,27 @@ void ConstelController::RequestHandle(const ps::SimpleData& recved,
         LOG(FATAL) << e.what();
         break;
       }
-      auto maintask = [app, strategy_block, this]() {
+      auto maintask = [app, strategy_block, ready_node_id, this]() {
         auto& transtopo = strategy_block.global_topo_;
         auto& global_model_sync_conf = strategy_block.global_model_sync_conf_;
         // Decide a new future timestamp
         uint32_t future_timestamp = this->GetFutureTimtestamp();
+        // the migration starts at future_timestamp on the old nodes' current
+        // topology, the new topology comes lead batches later
+        uint32_t lead = 0;
+        if (future_timestamp != 0 && !global_model_sync_conf.empty()) {
+          lead = migrate_lead_steps_;
+          for (const auto& [id, related_topo] : transtopo) {
+            if (id != ready_node_id &&
+                global_transtopo_.find(id) == global_transtopo_.end()) {
+              lead = 0;
+            }
+          }
+        }
 
         std::unordered_map<int, std::string> data;
         ScaleClock::Tick tick;
-        tick.timestamp = future_timestamp;
+        tick.timestamp = future_timestamp + lead;
 
         // update controller's tick to record the topo
         if (future_timestamp == 0) {
@@ -172,6 +187,11 @@ void ConstelController::RequestHandle(const ps::SimpleData& recved,
           } else {
             tick.model_sync_conf.Clear();
           }
+          // with a lead the senders catch the new node up when it enters
+          bool catch_up = lead > 0 && (id == ready_node_id ||
+                                       !tick.model_sync_conf.paths.empty());
+          tick.migrate_phase = catch_up ? ScaleClock::Tick::kMigrateCatchUp
+                                        : ScaleClock::Tick::kMigrateOnce;
           auto serialized_tick = serilite::serialize(tick);
           auto str = serialized_tick.as_string();
           data.emplace(std::make_pair(id, str));
@@ -182,6 +202,25 @@ void ConstelController::RequestHandle(const ps::SimpleData& recved,
         // send to all trainers and wait for response, should not wait!(dead
         // lock)
         app->Request(head, data);
+        if (lead > 0) {
+          // the senders migrate a snapshot at future_timestamp and keep
+          // their current topology until the new one
+          data.clear();
+          tick.timestamp = future_timestamp;
+          tick.migrate_phase = ScaleClock::Tick::kMigrateSnapshot;
+          for (const auto& [id, model_sync_conf] : global_model_sync_conf) {
+            if (id == ready_node_id) {
+              continue;
+            }
+            tick.transtopo.clear();
+            tick.transtopo[id] = global_transtopo_.at(id);
+            tick.model_sync_conf = model_sync_conf;
+            data.emplace(id, serilite::serialize(tick).as_string());
+            PS_VLOG(2) << "Send migration tick to node: " << id
+                       << " with tick: " << tick.debug_string();
+          }
+          app->Request(head, data);
+        }
         // set alarm for the new future timestamp
         tick.transtopo = transtopo;
         tick.model_sync_conf = {};
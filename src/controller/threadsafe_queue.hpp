@@ -1,30 +1,29 @@
 #pragma once
-#include <queue>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include "../utils/mpsc_queue.hpp"
+
+#include <utility>
 
 namespace constellation {
 
+/**
+ * @brief task queue of the controller main loop: many request handler
+ * threads push, only the main thread pops.
+ */
 template <typename T>
 class ThreadSafeQueue {
  private:
-  std::queue<T> queue;
-  mutable std::mutex mutex;
-  std::condition_variable cond;
+  MPSCQueue<T> queue;
 
  public:
+  explicit ThreadSafeQueue(size_t capacity = 1024) : queue(capacity) {}
+
   void push(T value) {
-    std::lock_guard<std::mutex> lock(mutex);
-    queue.push(value);
-    cond.notify_one();
+    queue.Push(std::move(value));
   }
 
   T pop() {
-    std::unique_lock<std::mutex> lock(mutex);
-    cond.wait(lock, [this] { return !queue.empty(); });
-    T value = queue.front();
-    queue.pop();
+    T value;
+    queue.WaitAndPop(&value);
     return value;
   }
 };
@@ -0,0 +1,31 @@
+#ifdef CONS_NETWORK_AWARE
+
+#include "./IncrementalTreeThinker.h"
+#include "../overlay/node_overlay_manager.h"
+
+namespace constellation {
+GlobalTransTopo IncrementalTreeThinker::decideNewTransTopo(
+    const StrategyRequest& req) {
+  auto& overlay = req.overlay->GetReadyOverlay();
+  int moves;
+  auto global_topo = algorithm::basic::incremental_tree(glb_topo_,
+                                                        overlay,
+                                                        edgeBandwidth(req),
+                                                        costModel(),
+                                                        max_depth_,
+                                                        max_fanout_,
+                                                        max_moves_,
+                                                        &moves);
+  if (global_topo.empty()) {
+    PS_VLOG(1) << "The transport tree does not extend to the overlay, "
+                  "build a new one";
+    return MaxBottleneckTreeThinker::decideNewTransTopo(req);
+  }
+  PS_VLOG(1) << "transport tree extended with " << moves << " moves";
+  setRankAndNum(global_topo);
+  return global_topo;
+}
+
+}  // namespace constellation
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef CONS_NETWORK_AWARE
+#error "Use this thinker should enable network aware"
+#endif
+
+#include "MaxBottleneckTreeThinker.h"
+
+namespace constellation {
+/**
+ * \brief extends the current transport tree to a joining node instead of
+ * building a new one, see algorithm::basic::incremental_tree, so only a few
+ * nodes reconfigure at the tick. At most CONSTEL_TREE_MAX_MOVES (default 2)
+ * nodes move to another parent per scale event. The first tree, and a tree
+ * that does not extend to the overlay, is built as MaxBottleneckTreeThinker
+ * does.
+ */
+class IncrementalTreeThinker : public MaxBottleneckTreeThinker {
+ protected:
+  virtual GlobalTransTopo decideNewTransTopo(
+      const StrategyRequest& req) override;
+
+  int max_moves_ = get_env("CONSTEL_TREE_MAX_MOVES", 2);
+};
+
+}  // namespace constellation
@@ -0,0 +1,97 @@
+#ifdef CONS_NETWORK_AWARE
+
+#include "./MaxBottleneckTreeThinker.h"
+#include "../overlay/network_aware/network_aware.h"
+
+namespace constellation {
+AdjacencyListT<float> MaxBottleneckTreeThinker::edgeBandwidth(
+    const StrategyRequest& req) {
+  auto* overlay_info =
+      dynamic_cast<aware::NetAWoverlayInfo*>(req.overlay.get());
+  if (overlay_info == nullptr) {
+    throw std::runtime_error(
+        "MaxBottleneckTreeThinker only support NetworkAwareOverlay. Please "
+        "enable network aware.");
+  }
+  auto& overlay = overlay_info->GetReadyOverlay();
+  AdjacencyListT<float> bandwidth;
+  for (const auto& [node, neighbors] : overlay) {
+    auto& bws = bandwidth[node];
+    for (const auto& neighbor : neighbors) {
+      bws.push_back(
+          overlay_info->get_edge_property(topo::Edge{node, neighbor}));
+    }
+  }
+  return bandwidth;
+}
+
+void MaxBottleneckTreeThinker::chooseExtraTrees(const StrategyRequest& req,
+                                                StrategyBlock* block) {
+  packExtraTrees(req, edgeBandwidth(req), block);
+}
+
+void MaxBottleneckTreeThinker::chooseScatterGroup(const StrategyRequest& req,
+                                                  GlobalTransTopo* transtopo) {
+  if (get_env_str("CONSTEL_COLLECTIVE", "tree") != "auto") {
+    ConstelThinker::chooseScatterGroup(req, transtopo);
+    return;
+  }
+  const auto& overlay = req.overlay->GetReadyOverlay();
+  auto bandwidth = edgeBandwidth(req);
+  // the smaller direction counts for both
+  auto speed = [&](int u, int v) {
+    auto at = [&](int a, int b) {
+      const auto& neighbors = overlay.at(a);
+      auto i = std::find(neighbors.begin(), neighbors.end(), b);
+      return bandwidth.at(a)[std::distance(neighbors.begin(), i)];
+    };
+    return std::min(at(u, v), at(v, u));
+  };
+  int root = 0;
+  for (const auto& [id, topo] : *transtopo) {
+    if (topo.getType() == NodeTransTopo::Type::kRoot) {
+      root = id;
+    }
+  }
+  auto group = algorithm::basic::set_scatter_group(
+      *transtopo, overlay, [&](int u, int v) {
+        return u == root || v == root ||
+               speed(u, v) >= std::min(speed(u, root), speed(v, root));
+      });
+  if (group.size() < 3) {
+    for (auto& [_, topo] : *transtopo) {
+      topo.scatter_group.clear();
+    }
+  }
+}
+
+algorithm::basic::TreeCostModel MaxBottleneckTreeThinker::costModel() const {
+  algorithm::basic::TreeCostModel model;
+  model.bytes = getParamsTotal();
+  model.latency = get_env("CONSTEL_TREE_LATENCY_US", 1000) / 1e6;
+  model.reduce_rate = get_env("CONSTEL_TREE_REDUCE_MBYTES_PER_S", 4000) * 1e6;
+  return model;
+}
+
+GlobalTransTopo MaxBottleneckTreeThinker::decideNewTransTopo(
+    const StrategyRequest& req) {
+  auto& overlay = req.overlay->GetReadyOverlay();
+  auto bandwidth = edgeBandwidth(req);
+  auto model = costModel();
+  float bottleneck;
+  auto global_topo = algorithm::basic::max_bottleneck_tree(
+      overlay, bandwidth, max_depth_, max_fanout_, model, &bottleneck);
+  if (global_topo.empty()) {
+    LOG(WARNING) << "No tree of depth <= " << max_depth_ << " and fan-out <= "
+                 << max_fanout_ << " spans the overlay, ignore the bounds";
+    global_topo = algorithm::basic::max_bottleneck_tree(
+        overlay, bandwidth, 0, 0, model, &bottleneck);
+  }
+  PS_VLOG(1) << "transport tree of bottleneck " << bottleneck << " Mbps";
+  setRankAndNum(global_topo);
+  return global_topo;
+}
+
+}  // namespace constellation
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef CONS_NETWORK_AWARE
+#error "Use this thinker should enable network aware"
+#endif
+
+#include "SimpleAdjTimeWeightedConfThinker.h"
+#include "../algorithm/basic.h"
+
+namespace constellation {
+/**
+ * \brief builds the transport tree over the widest links measured instead of
+ * a random one, see algorithm::basic::max_bottleneck_tree. The depth and the
+ * fan-out of the tree are bounded by CONSTEL_TREE_MAX_DEPTH and
+ * CONSTEL_TREE_MAX_FANOUT (0, the default, for no bound).
+ */
+class MaxBottleneckTreeThinker : public SimpleAdjTimeWeightedConfThinker {
+ protected:
+  virtual GlobalTransTopo decideNewTransTopo(
+      const StrategyRequest& req) override;
+
+  /**
+   * \brief the extra trees are packed into the measured bandwidth the main
+   * tree leaves, keys are striped by their bottleneck bandwidth
+   */
+  virtual void chooseExtraTrees(const StrategyRequest& req,
+                                StrategyBlock* block) override;
+
+  /**
+   * \brief with CONSTEL_COLLECTIVE "auto" two children of the root only join
+   * the scatter group together if their link is measured at least as fast as
+   * the slower of their links to the root
+   */
+  virtual void chooseScatterGroup(const StrategyRequest& req,
+                                  GlobalTransTopo* transtopo) override;
+
+  /** \brief the measured bandwidth of each edge, in the order of overlay */
+  AdjacencyListT<float> edgeBandwidth(const StrategyRequest& req);
+
+  /**
+   * \brief the cost model of an all-reduce of the model. The latency of an
+   * edge is CONSTEL_TREE_LATENCY_US (default 1000) and a node sums
+   * CONSTEL_TREE_REDUCE_MBYTES_PER_S megabytes per second (default 4000, 0
+   * if summing is free). Unlike the edge bandwidths this is in bytes, not
+   * bits.
+   */
+  algorithm::basic::TreeCostModel costModel() const;
+
+  int max_depth_ = get_env("CONSTEL_TREE_MAX_DEPTH", 0);
+  int max_fanout_ = get_env("CONSTEL_TREE_MAX_FANOUT", 0);
+};
+
+}  // namespace constellation
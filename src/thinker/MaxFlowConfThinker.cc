@@ -0,0 +1,53 @@
+#ifdef CONS_NETWORK_AWARE
+
+#include "./MaxFlowConfThinker.h"
+#include "../algorithm/basic.h"
+#include "../overlay/network_aware/network_aware.h"
+
+namespace constellation {
+
+GlobalModelSyncConf MaxFlowConfThinker::decideModelSyncConf(
+    const StrategyRequest& req) {
+  auto* overlay_info =
+      dynamic_cast<aware::NetAWoverlayInfo*>(req.overlay.get());
+  if (overlay_info == nullptr) {
+    throw std::runtime_error(
+        "MaxFlowConfThinker only support NetworkAwareOverlay. Please enable "
+        "network aware.");
+  }
+  auto& overlay = overlay_info->GetReadyOverlay();
+  const auto target = req.targets[0];
+
+  AdjacencyListT<float> capacity;
+  for (const auto& [src, neighbors] : overlay) {
+    capacity[src].resize(neighbors.size());
+    for (size_t i = 0; i < neighbors.size(); i++) {
+      capacity[src][i] =
+          overlay_info->get_edge_property(topo::Edge{src, neighbors[i]});
+    }
+  }
+  using namespace constellation::algorithm::basic;
+  std::vector<float> flows;
+  float max_flow;
+  auto paths = max_flow_paths(overlay, capacity, target, &flows, &max_flow);
+  if (paths.empty()) {
+    // no bandwidth measured towards the target yet, count links instead
+    LOG(WARNING) << "No measured bandwidth reaches " << target
+                 << ", plan the migration over unit capacities";
+    for (auto& [_, caps] : capacity) {
+      std::fill(caps.begin(), caps.end(), 1.0f);
+    }
+    paths = max_flow_paths(overlay, capacity, target, &flows, &max_flow);
+  }
+  PS_VLOG(1) << "migrate to " << target << " over " << paths.size()
+             << " paths of " << max_flow << " Mbps in total";
+
+  ModelLoadAssignment model_load_assignment;
+  for (size_t i = 0; i < paths.size(); i++) {
+    model_load_assignment.assignLoad(paths[i], flows[i]);
+  }
+  return ModelSycnConfTransform(target, model_load_assignment);
+}
+
+}  // namespace constellation
+#endif
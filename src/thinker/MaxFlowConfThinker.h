@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef CONS_NETWORK_AWARE
+#error "Use this thinker should enable network aware"
+#endif
+
+#include "SimpleThinker.h"
+
+namespace constellation {
+/**
+ * \brief migrates the model to a joining node over a maximum flow from all
+ * other nodes, see algorithm::basic::max_flow_paths, which minimizes the
+ * time of the transfer over the measured bandwidths.
+ */
+class MaxFlowConfThinker : public ConstelSimpleThinker {
+ private:
+  virtual GlobalModelSyncConf decideModelSyncConf(
+      const StrategyRequest& req) override;
+};
+
+}  // namespace constellation
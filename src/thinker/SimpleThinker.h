@@ -13,14 +13,14 @@ class ConstelSimpleThinker : public ConstelThinker {
       int target_id,
       ModelLoadAssignment& model_load_assignment);
 
+  virtual void setRankAndNum(GlobalTransTopo& transtopo);
+
  private:
   virtual StrategyBlock GenerateStrategyImpl(
       const StrategyRequest& req) override;
 
   virtual GlobalTransTopo decideNewTransTopo(const StrategyRequest& req);
 
-  virtual void setRankAndNum(GlobalTransTopo& transtopo);
-
   virtual GlobalModelSyncConf decideModelSyncConf(const StrategyRequest& req);
 };
 
@@ -115,6 +115,64 @@ void ConstelThinker::checkStrategy(const StrategyRequest& req,
     }
   }
 
+  // check the scatter group is the root and some of its children, all
+  // pairwise overlay neighbours, and every member agrees on it
+  std::vector<int> group;
+  if (root_id) {
+    group = transtopo.at(root_id).scatter_group;
+  }
+  if (group.size() == 1) {
+    throw TranstopoInvalidError("The scatter group is the root alone");
+  }
+  for (size_t i = 0; i < group.size(); ++i) {
+    auto member = transtopo.find(group[i]);
+    if (member == transtopo.end() || (i == 0 && group[i] != root_id) ||
+        (i > 0 && (member->second.getType() == NodeTransTopo::Type::kRoot ||
+                   member->second.getParent() != group[0])) ||
+        std::count(group.begin(), group.end(), group[i]) != 1) {
+      throw TranstopoInvalidError(
+          "The scatter group is not the root and some of its children");
+    }
+    for (size_t j = 0; j < i; ++j) {
+      if (!std_isin(group[j], overlay.at(group[i]))) {
+        throw NodeNotConnectedError(
+            "Two nodes in the scatter group are not connected",
+            group[i],
+            group[j]);
+      }
+    }
+  }
+  for (const auto& [id, topo] : transtopo) {
+    bool in_group = std_isin(id, group);
+    if (topo.scatter_group != (in_group ? group : std::vector<int>())) {
+      throw TranstopoInvalidError("The node " + std::to_string(id) +
+                                  " does not agree on the scatter group");
+    }
+  }
+
+  // check the extra trees span the same nodes over overlay links
+  if (strategy_block.tree_weights_.size() !=
+      (strategy_block.extra_topos_.empty()
+           ? 0
+           : strategy_block.extra_topos_.size() + 1)) {
+    throw TranstopoInvalidError("One weight per tree is expected");
+  }
+  for (const auto& extra : strategy_block.extra_topos_) {
+    if (!algorithm::helper::areElementsUniqueAndCorresponding(overlay,
+                                                              extra)) {
+      throw TranstopoInvalidError(
+          "Overlay and extra tree are not corresponding");
+    }
+    for (const auto& [id, topo] : extra) {
+      for (const auto& child : topo.getChildren()) {
+        if (!std_isin(child, overlay.at(id))) {
+          throw NodeNotConnectedError(
+              "Two nodes in an extra tree are not connected", id, child);
+        }
+      }
+    }
+  }
+
   // check the model load assignment
   // for (size_t i = 0; i < model_load_assignment.paths.size(); i++) {
   //   const auto& path = model_load_assignment.getPath(i);
@@ -127,6 +185,58 @@ void ConstelThinker::checkStrategy(const StrategyRequest& req,
   // }
 }
 
+void ConstelThinker::chooseScatterGroup(const StrategyRequest& req,
+                                        GlobalTransTopo* transtopo) {
+  auto mode = get_env_str("CONSTEL_COLLECTIVE", "tree");
+  if (mode != "tree" && mode != "rsag" && mode != "auto") {
+    throw std::runtime_error("Unknown CONSTEL_COLLECTIVE " + mode);
+  }
+  if (mode != "tree") {
+    auto group = algorithm::basic::set_scatter_group(
+        *transtopo, req.overlay->GetReadyOverlay());
+    if (mode == "rsag" || group.size() >= 3) {
+      return;
+    }
+  }
+  for (auto& [_, topo] : *transtopo) {
+    topo.scatter_group.clear();
+  }
+}
+
+void ConstelThinker::chooseExtraTrees(const StrategyRequest& req,
+                                      StrategyBlock* block) {
+  // unit capacity on every link, the trees are edge-disjoint
+  AdjacencyListT<float> capacity;
+  for (const auto& [u, neighbors] : req.overlay->GetReadyOverlay()) {
+    capacity[u].assign(neighbors.size(), 1.0f);
+  }
+  packExtraTrees(req, capacity, block);
+}
+
+void ConstelThinker::packExtraTrees(const StrategyRequest& req,
+                                    const AdjacencyListT<float>& capacity,
+                                    StrategyBlock* block) {
+  int64_t num_trees = get_env("CONSTEL_NUM_TREES", 1);
+  if (num_trees <= 1) {
+    return;
+  }
+  const auto& overlay = req.overlay->GetReadyOverlay();
+  AdjacencyListT<float> left;
+  float main_bottleneck = algorithm::basic::take_tree_capacity(
+      block->global_topo_, overlay, capacity, &left);
+  if (main_bottleneck <= 0) {
+    return;
+  }
+  std::vector<float> bottlenecks;
+  block->extra_topos_ = algorithm::basic::pack_spanning_trees(
+      overlay, left, num_trees - 1, &bottlenecks);
+  if (!block->extra_topos_.empty()) {
+    block->tree_weights_ = {main_bottleneck};
+    block->tree_weights_.insert(
+        block->tree_weights_.end(), bottlenecks.begin(), bottlenecks.end());
+  }
+}
+
 std::shared_ptr<Extra> ConstelThinker::obtainExtra(
     ConstelController* controller) {
   return nullptr;
@@ -135,7 +245,31 @@ std::shared_ptr<Extra> ConstelThinker::obtainExtra(
 const StrategyBlock& ConstelThinker::GenerateStrategy(
     const StrategyRequest& req) {
   auto strategy_block = this->GenerateStrategyImpl(req);
+  auto& transtopo = strategy_block.global_topo_;
+  if (strategy_block.extra_topos_.empty()) {
+    chooseExtraTrees(req, &strategy_block);
+  }
+  chooseScatterGroup(req, &transtopo);
   checkStrategy(req, strategy_block);
+  // every node learns its place in the extra trees, checked to span the
+  // same nodes
+  for (auto& [id, topo] : transtopo) {
+    topo.extra_trees.clear();
+    topo.tree_weights.clear();
+    if (strategy_block.extra_topos_.empty()) {
+      continue;
+    }
+    topo.tree_weights = strategy_block.tree_weights_;
+    for (const auto& extra : strategy_block.extra_topos_) {
+      const auto& node = extra.at(id);
+      TreeLinks links;
+      links.parent = node.getType() == NodeTransTopo::Type::kRoot
+                         ? 0
+                         : node.getParent();
+      links.children = node.getChildren();
+      topo.extra_trees.push_back(std::move(links));
+    }
+  }
   this->strategy_block_ = std::move(strategy_block);
   return this->strategy_block_;
 }
@@ -11,6 +11,9 @@
 #include "./FAPTEqualConfThinker.h"
 #include "./FAPTTimeWeightedConfThinker.h"
 #include "./LayerwiseTimeWeightedConfThinker.h"
+#include "./MaxBottleneckTreeThinker.h"
+#include "./IncrementalTreeThinker.h"
+#include "./MaxFlowConfThinker.h"
 #endif
 
 namespace constellation {
@@ -51,6 +54,10 @@ ThinkerFactory::InitializeThinkerMap() {
        []() { return new RoundRobinTimeWeightedThinker(); }},
       {"LayerwiseTimeWeightedConfThinker",
        []() { return new LayerwiseTimeWeightedConfThinker(); }},
+      {"MaxBottleneckTreeThinker",
+       []() { return new MaxBottleneckTreeThinker(); }},
+      {"IncrementalTreeThinker", []() { return new IncrementalTreeThinker(); }},
+      {"MaxFlowConfThinker", []() { return new MaxFlowConfThinker(); }},
 #endif
   };
 }
@@ -1,14 +1,22 @@
 #include "constellation_trainer.h"
 
+#include "../compressor/compressor.h"
+#include "../utils/key_table.hpp"
 #include "../utils/serilite.hpp"
 #include "engine.hpp"
+#include "fusion.h"
+#include "reducer.h"
+#include "row_sparse.h"
 #include "time_recorder.h"
 
 #if CONS_NETWORK_AWARE
 #include "clusterRM/smq.h"
 #endif
 
+#include <algorithm>
+#include <deque>
 #include <functional>
+#include <numeric>
 #include <unordered_set>
 
 namespace constellation {
@@ -55,6 +63,7 @@ ModelSycnConf CreateModelSyncConfig(const std::vector<int>& path,
 }  // namespace
 
 ConstelTrainer::ConstelTrainer() {
+  key_states_ = new KeyTable<KeyState>();
   ps::StartAsync(0, "ConstelTrainer");
   this->trainer_ = new ps::KVTrainer<char>(0, 0);  // app_id, customer_id
   using namespace std::placeholders;
@@ -80,18 +89,30 @@ ConstelTrainer::ConstelTrainer() {
       [this] { test_client_->start_client(ps::Postoffice::Get()->GetMyID()); });
 #endif
   //  init engine
-  InitEngine(2);
+  InitEngine(get_env("CONSTEL_ENGINE_THREADS", 2));
+  PS_VLOG(1) << "reduction kernels use "
+             << reducer::SimdLevelName(reducer::GetSimdLevel());
   // time recorder
   batch_t_ = std::make_shared<TimeRecoder>("ms");
   rtt_window_ = std::make_shared<WindowedBuffer<int64_t>>(3);
 }
 
 ConstelTrainer::~ConstelTrainer() {
+  if (migrate_thread_) {
+    // the queued migrations are sent before the transport goes down
+    {
+      std::lock_guard<std::mutex> lock(migrate_mu_);
+      migrate_tasks_.emplace_back();
+      migrate_cv_.notify_one();
+    }
+    migrate_thread_->join();
+  }
   ps::Finalize(0, false);
   delete this->trainer_;
   this->trainer_ = nullptr;
   engine_->Stop();
   delete engine_;
+  delete key_states_;
 #if CONS_NETWORK_AWARE
   test_client_->stop_smq();
   test_client_thread_->join();
@@ -116,6 +137,8 @@ void ConstelTrainer::NotifyReadyAndWait(bool need_sycn_model,
       for (size_t i = 0; i < keys.size(); i++) {
         model_info_[keys[i]] = lens[i];
         model_size_ += lens[i];
+        // create the state up front, off the receive path
+        GetKeyState(keys[i]);
       }
     }
     auto body = ReadySignalBody{
@@ -123,13 +146,30 @@ void ConstelTrainer::NotifyReadyAndWait(bool need_sycn_model,
     std::string body_str = serilite::serialize(body).as_string();
     // no need wait
     trainer_->Request(head, body_str, ps::kScheduler);
-    while (!is_ctx_ready_.load()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    std::unique_lock<std::mutex> lock(ctx_ready_mu_);
+    ctx_ready_cv_.wait(lock, [this] { return this->is_ctx_ready_.load(); });
   }
 }
 
 bool ConstelTrainer::BatchEnd(std::vector<int>* keys_to_migrate) {
+  ++num_batches_;
+  if (rebalance_interval_ > 0 && num_batches_ % rebalance_interval_ == 0) {
+    size_t moved = engine_->Rebalance();
+    if (moved > 0) {
+      auto stats = engine_->GetLoadStats();
+      std::string loads;
+      for (auto cost : stats.thread_cost_ns) {
+        loads += std::to_string(cost / 1000) + "us ";
+      }
+      PS_VLOG(2) << "engine rebalance moved " << moved
+                 << " keys, thread loads: " << loads;
+    }
+    auto pool = MemoryPool::Get()->GetStats();
+    PS_VLOG(2) << "memory pool hits: " << pool.hits
+               << " misses: " << pool.misses
+               << " cached: " << (pool.bytes_cached >> 10) << "KB"
+               << " in use: " << (pool.bytes_in_use >> 10) << "KB";
+  }
   auto ticked = clock_.clockTick();
   auto timestamp = clock_.getLocalTimestamp();
   if (isRootNode()) {
@@ -140,12 +180,17 @@ bool ConstelTrainer::BatchEnd(std::vector<int>* keys_to_migrate) {
     keys_to_migrate->clear();
   }
   model_sync_conf_.Clear();
+  migrate_phase_ = ScaleClock::Tick::kMigrateOnce;
+  migrate_base_.clear();
   if (!ticked) {
     // no alarm
     return true;
   }
 
   // there is a alarm
+  // the buffers cached for the old topology and the last migration are of
+  // sizes that may not come back
+  MemoryPool::Get()->Trim();
   // notify the scheduler to update the clock
   if (isRootNode()) {
     auto body = ClockSignalBody{myid(),
@@ -166,6 +211,16 @@ bool ConstelTrainer::BatchEnd(std::vector<int>* keys_to_migrate) {
   auto& local_transtopo = it->second;
   this->SetNodeTransTopo(local_transtopo);
 
+  // a new snapshot starts empty and the catch-up uses up the old one, even
+  // if Migrate is not called
+  migrate_phase_ = ticked->migrate_phase;
+  if (migrate_phase_ != ScaleClock::Tick::kMigrateOnce) {
+    if (migrate_phase_ == ScaleClock::Tick::kMigrateCatchUp) {
+      migrate_base_ = std::move(migrate_snapshot_);
+    }
+    migrate_snapshot_.clear();
+  }
+
   if (!model_sync_conf.paths.empty()) {
     PS_VLOG(2) << "BatchEnd Model Sync Conf: "
                << model_sync_conf.debug_string();
@@ -195,56 +250,168 @@ bool ConstelTrainer::BatchEnd(std::vector<int>* keys_to_migrate) {
 void ConstelTrainer::Migrate(const std::vector<int>& keys,
                              const std::vector<CArray>& vals) {
   CHECK_EQ(keys.size(), vals.size());
-  int size = this->model_sync_conf_.paths.size();
-  for (size_t i = 0; i < size; i++) {
-    const auto& path = this->model_sync_conf_.paths[i];
-    if (path.size() < 2 || path[0] != ps::Postoffice::Get()->GetMyID()) {
-      continue;
+  std::vector<CArray> base;
+  // before the joining node enters keep what it gets, when it enters send
+  // the change since then
+  bool keep =
+      migrate_phase_ == ScaleClock::Tick::kMigrateSnapshot && migrate_delta_;
+  if (migrate_phase_ == ScaleClock::Tick::kMigrateCatchUp &&
+      !migrate_base_.empty()) {
+    for (int key : keys) {
+      auto it = migrate_base_.find(key);
+      base.push_back(it != migrate_base_.end() ? it->second : CArray());
     }
-    for (const auto& kvslice : this->model_sync_conf_.kvslices[i]) {
-      if (kvslice.is_full()) {
-        MigrateFullSlice(path, keys, vals, kvslice);
-      } else {
-        MigratePartialSlice(path, keys, vals, kvslice);
-      }
+    migrate_base_.clear();
+  }
+  if (!migrate_async_ && !keep) {
+    StreamMigration(model_sync_conf_, keys, vals, base);
+    return;
+  }
+  auto snapshot = SnapshotMigrateValues(vals);
+  if (keep) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      migrate_snapshot_[keys[i]] = snapshot[i];
     }
   }
+  if (!migrate_async_) {
+    StreamMigration(model_sync_conf_, keys, snapshot, base);
+    return;
+  }
+  // model_sync_conf_ is cleared at the next batch end, take a copy
+  auto task = [this,
+               conf = model_sync_conf_,
+               keys,
+               vals = std::move(snapshot),
+               base = std::move(base)]() {
+    StreamMigration(conf, keys, vals, base);
+  };
+  std::lock_guard<std::mutex> lock(migrate_mu_);
+  migrate_tasks_.push_back(std::move(task));
+  migrate_cv_.notify_one();
 }
 
-void ConstelTrainer::MigrateFullSlice(const std::vector<int>& path,
-                                      const std::vector<int>& keys,
-                                      const std::vector<CArray>& vals,
-                                      const KVSlice& kvslice) {
-  for (int key = kvslice.key_begin; key < kvslice.key_end; key++) {
-    auto it = std::find(keys.begin(), keys.end(), key);
-    CHECK(it != keys.end()) << "key " << key << " is not in the keys";
-    int idx = std::distance(keys.begin(), it);
-
-    auto kvdata = PrepareKVPair(key, vals[idx]);
-    auto conf = CreateModelSyncConfig(path, myid(), KVSlice{key, key + 1});
-    auto conf_str = serilite::serialize(conf).as_string();
+void ConstelTrainer::MigrateLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(migrate_mu_);
+      migrate_cv_.wait(lock, [this] { return !migrate_tasks_.empty(); });
+      task = std::move(migrate_tasks_.front());
+      migrate_tasks_.pop_front();
+    }
+    if (!task) {
+      break;
+    }
+    task();
+  }
+}
 
-    trainer_->ZMove(
-        path[1], kvdata.keys, kvdata.values, kvdata.lens, conf_str, kvdata.cmd);
+void ConstelTrainer::StreamMigration(const ModelSycnConf& conf,
+                                     const std::vector<int>& keys,
+                                     const std::vector<CArray>& vals,
+                                     const std::vector<CArray>& base) {
+  // every path is a stream of chunks with at most migrate_window_ its next
+  // hop has not acknowledged. An acknowledgement refills the window of its
+  // own path, so a fast path is never held up by a slow one
+  struct Stream {
+    const std::vector<int>* path;
+    std::vector<KVSlice> chunks;
+    size_t next = 0;
+  };
+  // filled by the acknowledgement callbacks, which may outlive this call
+  struct Acks {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<size_t> streams;
+  };
+  std::vector<Stream> streams;
+  int size = conf.paths.size();
+  for (size_t i = 0; i < size; i++) {
+    const auto& path = conf.paths[i];
+    if (path.size() < 2 || path[0] != ps::Postoffice::Get()->GetMyID()) {
+      continue;
+    }
+    Stream stream;
+    stream.path = &path;
+    for (const auto& kvslice : conf.kvslices[i]) {
+      auto chunks =
+          PlanMigrateChunks(kvslice, keys, vals, migrate_chunk_bytes_);
+      stream.chunks.insert(stream.chunks.end(), chunks.begin(), chunks.end());
+    }
+    streams.push_back(std::move(stream));
+  }
+  auto acks = std::make_shared<Acks>();
+  size_t unsent = 0;
+  auto send = [&](size_t s) {
+    auto& stream = streams[s];
+    MigrateChunk(*stream.path,
+                 keys,
+                 vals,
+                 base,
+                 stream.chunks[stream.next++],
+                 [acks, s]() {
+                   std::lock_guard<std::mutex> lock(acks->mu);
+                   acks->streams.push_back(s);
+                   acks->cv.notify_one();
+                 });
+    unsent--;
+  };
+  for (size_t s = 0; s < streams.size(); s++) {
+    unsent += streams[s].chunks.size();
+    for (size_t i = 0; i < migrate_window_ && i < streams[s].chunks.size();
+         i++) {
+      send(s);
+    }
+  }
+  // the chunks still in flight once all are sent are not waited for
+  while (unsent > 0) {
+    size_t s;
+    {
+      std::unique_lock<std::mutex> lock(acks->mu);
+      acks->cv.wait(lock, [&acks] { return !acks->streams.empty(); });
+      s = acks->streams.front();
+      acks->streams.pop_front();
+    }
+    if (streams[s].next < streams[s].chunks.size()) {
+      send(s);
+    }
   }
 }
 
-void ConstelTrainer::MigratePartialSlice(const std::vector<int>& path,
-                                         const std::vector<int>& keys,
-                                         const std::vector<CArray>& vals,
-                                         const KVSlice& kvslice) {
+void ConstelTrainer::MigrateChunk(const std::vector<int>& path,
+                                  const std::vector<int>& keys,
+                                  const std::vector<CArray>& vals,
+                                  const std::vector<CArray>& base,
+                                  const KVSlice& kvslice,
+                                  const std::function<void()>& on_ack) {
   int key = kvslice.key_begin;
   auto it = std::find(keys.begin(), keys.end(), key);
   CHECK(it != keys.end()) << "key " << key << " is not in the keys";
   int idx = std::distance(keys.begin(), it);
+  const auto& val = vals[idx];
 
-  auto kvdata = PrepareKVPair(key, vals[idx], kvslice.slice, kvslice.slice_len);
-  auto conf = CreateModelSyncConfig(
-      path, myid(), KVSlice{key, kvslice.slice, kvslice.slice_len});
+  KVPairData kvdata;
+  if (!base.empty() && base[idx].size() == val.size()) {
+    uint64_t offset = kvslice.is_full() ? 0 : kvslice.slice;
+    uint64_t len = kvslice.is_full() ? val.size() : kvslice.slice_len;
+    kvdata =
+        PrepareKVPair(key, EncodeMigrateDelta(val, base[idx], offset, len));
+    kvdata.cmd = GetCommandType(RequestType::kModelSyncDelta, val.dtype);
+  } else if (kvslice.is_full()) {
+    kvdata = PrepareKVPair(key, val);
+  } else {
+    kvdata = PrepareKVPair(key, val, kvslice.slice, kvslice.slice_len);
+  }
+  auto conf = CreateModelSyncConfig(path, myid(), kvslice);
   auto conf_str = serilite::serialize(conf).as_string();
 
-  trainer_->ZMove(
-      path[1], kvdata.keys, kvdata.values, kvdata.lens, conf_str, kvdata.cmd);
+  trainer_->ZMove(path[1],
+                  kvdata.keys,
+                  kvdata.values,
+                  kvdata.lens,
+                  conf_str,
+                  kvdata.cmd,
+                  on_ack);
 }
 
 void ConstelTrainer::NotifySchedulerUpdateClock(const ClockSignalBody& body) {
@@ -280,29 +447,235 @@ void ConstelTrainer::Broadcast(const std::vector<int>& keys,
 
 void ConstelTrainer::Recv(const std::vector<int>& keys,
                           const std::vector<CArray*>& vals) {
+  CHECK_EQ(keys.size(), vals.size());
   std::unique_lock<std::mutex> lock(model_sync_mu_);
-  wait_recv_keys_ = const_cast<std::vector<int>*>(&keys);
-  wait_recv_vals_ = const_cast<std::vector<CArray*>*>(&vals);
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto it = model_info_.find(keys[i]);
+    if (it != model_info_.end()) {
+      CHECK_EQ(vals[i]->size(), it->second)
+          << "the buffer of key " << keys[i] << " does not fit the model";
+    }
+    recv_bufs_[keys[i]] = vals[i];
+  }
+  recv_posted_ = true;
+  // wake the receive handlers waiting for the buffers
+  model_sync_cv_.notify_all();
   model_sync_cv_.wait(lock, [this] { return this->is_model_sync_.load(); });
-  wait_recv_keys_ = nullptr;
-  wait_recv_vals_ = nullptr;
+  recv_bufs_.clear();
+  recv_posted_ = false;
+}
+
+PushPullHandle::PushPullHandle(size_t num_keys) : key_parts_(num_keys) {}
+
+bool PushPullHandle::Poll() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return num_done_ == part_done_.size();
+}
+
+void PushPullHandle::Wait() const {
+  std::unique_lock<std::mutex> lock(mu_);
+  cv_.wait(lock, [this] { return num_done_ == part_done_.size(); });
+}
+
+bool PushPullHandle::PollKey(size_t i) const {
+  CHECK_LT(i, key_parts_.size());
+  std::lock_guard<std::mutex> lock(mu_);
+  return IsKeyDone(i);
+}
+
+void PushPullHandle::WaitKey(size_t i) const {
+  CHECK_LT(i, key_parts_.size());
+  std::unique_lock<std::mutex> lock(mu_);
+  cv_.wait(lock, [this, i] { return IsKeyDone(i); });
+}
+
+bool PushPullHandle::IsKeyDone(size_t i) const {
+  for (auto part : key_parts_[i]) {
+    if (!part_done_[part]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t PushPullHandle::AddPart(size_t key_index) {
+  size_t part = part_done_.size();
+  part_done_.push_back(false);
+  key_parts_[key_index].push_back(part);
+  return part;
+}
+
+void PushPullHandle::MarkDone(size_t part) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    CHECK(!part_done_[part]);
+    part_done_[part] = true;
+    num_done_++;
+  }
+  cv_.notify_all();
 }
 
 void ConstelTrainer::PushPull(const std::vector<int>& keys,
                               const std::vector<CArray>& vals_push,
-                              const std::vector<CArray*>& vals_pull) {
+                              const std::vector<CArray*>& vals_pull,
+                              const std::vector<int>& priorities) {
+  PushPullAsync(keys, vals_push, vals_pull, priorities)->Wait();
+}
+
+std::shared_ptr<PushPullHandle> ConstelTrainer::PushPullAsync(
+    const std::vector<int>& keys,
+    const std::vector<CArray>& vals_push,
+    const std::vector<CArray*>& vals_pull,
+    const std::vector<int>& priorities) {
+  CHECK_EQ(vals_push.size(), keys.size());
+  CHECK_EQ(vals_pull.size(), keys.size());
+  CHECK(priorities.empty() || priorities.size() == keys.size());
+  auto handle = std::make_shared<PushPullHandle>(keys.size());
+  auto priority_of = [&priorities](size_t i) {
+    return priorities.empty() ? 0 : priorities[i];
+  };
+  // without fusion every key is a bucket of its own
+  auto buckets = PlanFusionBuckets(keys, vals_push, fusion_bucket_bytes_);
+  std::vector<int> wire_keys;
+  std::vector<CArray> wire_push;
+  std::vector<int> wire_priorities;
+  std::vector<PendingPushPull> pendings;
+  for (const auto& bucket : buckets) {
+    if (!bucket.fused()) {
+      size_t m = bucket.members[0];
+      auto chunks = PlanKeyChunks(
+          keys[m], bucket.size, bucket.dtype, pipeline_chunk_bytes_);
+      if (chunks.size() == 1) {
+        wire_keys.push_back(keys[m]);
+        wire_push.push_back(vals_push[m]);
+        wire_priorities.push_back(priority_of(m));
+        pendings.push_back({handle, {handle->AddPart(m)}, vals_pull[m]});
+        continue;
+      }
+      // the pulled value of a chunk is copied straight into its slice of the
+      // caller's output
+      for (const auto& chunk : chunks) {
+        wire_keys.push_back(chunk.key);
+        wire_priorities.push_back(priority_of(m));
+        wire_push.emplace_back(
+            vals_push[m].data() + chunk.offset, chunk.size, bucket.dtype);
+        handle->bufs_.emplace_back(
+            vals_pull[m]->data() + chunk.offset, chunk.size, bucket.dtype);
+        pendings.push_back(
+            {handle, {handle->AddPart(m)}, &handle->bufs_.back()});
+      }
+      continue;
+    }
+    // the same buffer serves the push and the pull, the pushed value is
+    // consumed by the engine before the pulled one is written back
+    auto& buf = fusion_bufs_[bucket.key];
+    if (buf.isNone() || buf.size() != bucket.size) {
+      buf = CArray(bucket.size, bucket.dtype);
+    }
+    buf.dtype = bucket.dtype;
+    for (size_t j = 0; j < bucket.members.size(); ++j) {
+      const auto& val = vals_push[bucket.members[j]];
+      buf.CopyFrom(val.data(), val.size(), bucket.offsets[j]);
+    }
+    // a bucket is as urgent as its most urgent member
+    int priority = priority_of(bucket.members[0]);
+    for (auto m : bucket.members) {
+      priority = std::max(priority, priority_of(m));
+    }
+    wire_keys.push_back(bucket.key);
+    wire_push.push_back(buf);
+    wire_priorities.push_back(priority);
+    handle->bufs_.push_back(buf);
+    PendingPushPull pending{handle, {}, &handle->bufs_.back()};
+    for (auto m : bucket.members) {
+      pending.parts.push_back(handle->AddPart(m));
+    }
+    // scatter the bucket into the members' outputs once it is pulled back
+    std::vector<CArray*> outs;
+    for (auto m : bucket.members) {
+      outs.push_back(vals_pull[m]);
+    }
+    auto* fused = pending.out;
+    auto offsets = bucket.offsets;
+    pending.on_done = [fused, outs, offsets]() {
+      for (size_t j = 0; j < outs.size(); ++j) {
+        outs[j]->CopyFrom(fused->data() + offsets[j], outs[j]->size());
+      }
+    };
+    pendings.push_back(std::move(pending));
+  }
+  AddPendingPushPull(wire_keys, &pendings);
+  SubmitPushPull(wire_keys,
+                 wire_push,
+                 priorities.empty() ? priorities : wire_priorities);
+  return handle;
+}
+
+void ConstelTrainer::PushPullRowSparse(
+    const std::vector<int>& keys,
+    const std::vector<std::vector<uint64_t>>& row_ids,
+    const std::vector<CArray>& vals_push,
+    std::vector<std::vector<uint64_t>>* row_ids_pull,
+    std::vector<CArray>* vals_pull,
+    const std::vector<int>& priorities) {
+  CHECK_EQ(row_ids.size(), keys.size());
+  CHECK_EQ(vals_push.size(), keys.size());
+  CHECK(priorities.empty() || priorities.size() == keys.size());
+  row_ids_pull->resize(keys.size());
+  vals_pull->resize(keys.size());
+  auto handle = std::make_shared<PushPullHandle>(keys.size());
+  std::vector<CArray> packed(keys.size());
+  std::vector<PendingPushPull> pendings;
+  for (size_t i = 0; i < keys.size(); i++) {
+    packed[i] = PackRowSparse(row_ids[i], vals_push[i]);
+    // the merged rows are a fresh buffer of each round, so the result is
+    // taken over instead of copied, and unpacked in place
+    handle->bufs_.emplace_back();
+    auto* result = &handle->bufs_.back();
+    PendingPushPull pending{handle, {handle->AddPart(i)}, result};
+    pending.adopt = true;
+    auto* ids = &(*row_ids_pull)[i];
+    auto* rows = &(*vals_pull)[i];
+    pending.on_done = [result, ids, rows]() {
+      UnpackRowSparse(*result, ids, rows);
+    };
+    pendings.push_back(std::move(pending));
+  }
+  AddPendingPushPull(keys, &pendings);
+  SubmitPushPull(keys, packed, priorities, TaskTypeEnum::kRowSparsePushPull);
+  handle->Wait();
+}
+
+void ConstelTrainer::AddPendingPushPull(
+    const std::vector<int>& keys,
+    std::vector<PendingPushPull>* pendings) {
+  CHECK_EQ(pendings->size(), keys.size());
+  std::lock_guard<std::mutex> lock(pending_pushpull_mu_);
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool inserted =
+        pending_pushpull_.emplace(keys[i], std::move((*pendings)[i])).second;
+    CHECK(inserted) << "key " << keys[i] << " is already in flight";
+  }
+}
+
+void ConstelTrainer::SubmitPushPull(const std::vector<int>& keys,
+                                    const std::vector<CArray>& vals_push,
+                                    const std::vector<int>& priorities,
+                                    TaskTypeEnum type) {
   int size = keys.size();
   CHECK_EQ(vals_push.size(), size);
-  CHECK_EQ(vals_pull.size(), size);
-  std::unordered_map<int, int> res_map;
-  std::vector<EngineTaskData> vals(
-      size, {UpdateBuf(), TaskTypeEnum::kPushPull, true});
+  std::vector<EngineTaskData> vals(size, {UpdateBuf(), type, true});
   // TODO: need consider merge the key-value if there more than one gpus
   for (size_t i = 0; i < size; i++) {
-    // submit the key-value, and get the timestamp which the corresponding
-    // merged value is pushed to the father node
+    // submit the key-value, FinishPushPull completes it once the merged
+    // value is pulled back from the father node
     auto& update = vals[i].update_buf;
     update.merged = vals_push[i];
+    vals[i].priority = priorities.empty() ? 0 : priorities[i];
+    if (type == TaskTypeEnum::kPushPull) {
+      vals[i].tree =
+          PickTree(keys[i], vals_push[i].size(), vals_push[i].dtype);
+    }
   }
   auto now = clock_.getLocalTimestamp();
   cached_kv_mu_.lock();
@@ -310,40 +683,257 @@ void ConstelTrainer::PushPull(const std::vector<int>& keys,
     size_t size = cached_kv_[now].size();
     auto keys_ = std::vector<int>(size);
     auto datas_ = std::vector<EngineTaskData>(size);
+    auto prios_ = std::vector<int>(size);
     size_t i = 0;
     for (auto& data : cached_kv_[now]) {
       keys_[i] = data.first;
       datas_[i] = data.second;
+      prios_[i] = data.second.priority;
       i++;
     }
-    engine_->PushAsync(keys_, std::move(datas_));
+    engine_->PushAsync(keys_, std::move(datas_), prios_);
     cached_kv_.erase(now);
   }
   cached_kv_mu_.unlock();
-  engine_->PushAndWait(keys, std::move(vals), &res_map);
-  for (auto& it : res_map) {
-    int key = it.first;
-    auto key_it = std::find_if(
-        keys.begin(), keys.end(), [key](int k) { return k == key; });
-    CHECK_NE(key_it, keys.end());
-    int i = std::distance(keys.begin(), key_it);
-    if (it.second > 0) {
-      // for root node,  no need to Wait
-      trainer_->Wait(it.second);
-    }
-    // put pullback data to vals_pull from the update buf
-    auto* buf = GetUpdateBuf(key);
-    vals_pull[i]->CopyFrom(buf->merged);
-    // 2. 用记录的meta去回复子节点，带上pull回来的数据
-    for (const auto& meta : buf->request_meta) {
-      ps::KVPairs<char> pairs;
-      pairs.keys.push_back(key);
-      pairs.vals = ps::SArray<char>(buf->merged);
-      auto len = static_cast<int>(buf->merged.size());  // bytes
-      pairs.lens = {len};
-      trainer_->Response(meta, pairs);
+  engine_->PushAsync(keys, std::move(vals), priorities);
+}
+
+ConstelTrainer::KeyState* ConstelTrainer::GetKeyState(int key) {
+  return key_states_->Get(key);
+}
+
+bool ConstelTrainer::ShouldCompress(size_t size, int dtype) const {
+  return !compressor_spec_.empty() && size >= compress_min_bytes_ &&
+         dtype == static_cast<int>(ConstelDataType::CONSTEL_FLOAT32);
+}
+
+Compressor* ConstelTrainer::GetCompressor(int key, bool up) {
+  auto* state = GetKeyState(key);
+  auto& compressor = up ? state->up_compressor : state->down_compressor;
+  if (!compressor) {
+    compressor = CompressorFactory::CreateCompressor(compressor_spec_,
+                                                     compress_error_feedback_);
+    CHECK(compressor) << "compressed PushPull of key " << key
+                      << " but CONSTEL_COMPRESSOR is not set";
+  }
+  return compressor.get();
+}
+
+int ConstelTrainer::PickTree(int key, size_t size, int dtype) const {
+  std::vector<float> weights;
+  {
+    std::unique_lock<std::mutex> lock(trans_topo_mu_);
+    weights = trans_topo_.tree_weights;
+  }
+  if (weights.size() < 2 || ShouldCompress(size, dtype)) {
+    return 0;
+  }
+  // splitmix64, the keys of a model and its chunks are consecutive
+  uint64_t h = static_cast<uint64_t>(key) + 0x9E3779B97F4A7C15ull;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  h ^= h >> 31;
+  double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  double x = (h >> 11) * (1.0 / (1ull << 53)) * total;
+  for (size_t tree = 0; tree < weights.size(); ++tree) {
+    x -= weights[tree];
+    if (x < 0) {
+      return tree;
+    }
+  }
+  return weights.size() - 1;
+}
+
+bool ConstelTrainer::UseScatterGather(size_t size, int dtype) const {
+  if (size < scatter_min_bytes_ || ShouldCompress(size, dtype)) {
+    return false;
+  }
+  auto group = GetScatterGroup();
+  // every member gets a segment of at least a cache line
+  return group.size() >= 2 && size >= group.size() * 64 &&
+         std_isin(ps::Postoffice::Get()->GetMyID(), group);
+}
+
+/**
+ * \brief the extra of a message on an extra tree: the tree, followed by
+ * ",timestamp" of the sender
+ */
+static std::string MakeTreeExtra(int tree, uint32_t timestamp) {
+  return std::to_string(tree) + "," + std::to_string(timestamp);
+}
+
+static void ParseTreeExtra(const std::string& extra,
+                           int* tree,
+                           uint32_t* timestamp) {
+  auto pos = extra.find(',');
+  *tree = std::stoi(extra.substr(0, pos));
+  *timestamp =
+      pos == std::string::npos ? 0 : std::stoul(extra.substr(pos + 1));
+}
+
+static size_t ScatterGroupIndex(const std::vector<int>& group, int id) {
+  auto it = std::find(group.begin(), group.end(), id);
+  CHECK(it != group.end()) << "node " << id << " is not in the scatter group";
+  return std::distance(group.begin(), it);
+}
+
+void ConstelTrainer::StartScatterGather(int key, const CArray& partial) {
+  auto group = GetScatterGroup();
+  size_t num = group.size();
+  size_t me = ScatterGroupIndex(group, myid());
+  auto* state = GetKeyState(key);
+  auto& sg = state->scatter_gather;
+  CHECK(!sg.started) << "reduce-scatter of key " << key << " is in flight";
+  auto& buf = sg.bufs[state->update_buf.round % 2];
+  if (buf.isNone() || buf.size() != partial.size()) {
+    buf = CArray(partial.size(), partial.dtype);
+  }
+  buf.dtype = partial.dtype;
+  sg.result = buf;
+  // `partial` outlives the sends: the round only completes once every
+  // member has received and summed its segment
+  ps::SArray<ps::Key> keys({static_cast<ps::Key>(key)});
+  auto vals = ps::SArray<char>(partial);
+  int cmd = GetCommandType(RequestType::kReduceScatter, partial.dtype);
+  for (size_t i = 0; i < num; ++i) {
+    auto seg = PlanScatterSegment(key, partial.size(), partial.dtype, num, i);
+    if (i == me) {
+      sg.result.CopyFrom(partial.data() + seg.offset, seg.size, seg.offset);
+      continue;
+    }
+    trainer_->ZMove(group[i],
+                    keys,
+                    vals.segment(seg.offset, seg.offset + seg.size),
+                    ps::SArray<uint64_t>({static_cast<uint64_t>(seg.size)}),
+                    "",
+                    cmd);
+  }
+  sg.started = true;
+  AdvanceScatterGather(key);
+}
+
+void ConstelTrainer::ProcessScatterGather(int key, const EngineTaskData& data) {
+  auto& sg = GetKeyState(key)->scatter_gather;
+  const auto& value = data.update_buf.merged;
+  if (data.type == TaskTypeEnum::kReduceScatter) {
+    // summed once the round has started here and only into its own round
+    sg.inbox.push_back(value);
+  } else {
+    // a member only gathers after it got the segment of every other one
+    CHECK(sg.started) << "all-gather of key " << key << " before its round";
+    auto seg = PlanScatterSegment(key,
+                                  sg.result.size(),
+                                  sg.result.dtype,
+                                  GetScatterGroup().size(),
+                                  data.segment);
+    CHECK_EQ(seg.size, value.size());
+    sg.result.CopyFrom(value.data(), value.size(), seg.offset);
+    sg.num_gathered++;
+  }
+  AdvanceScatterGather(key);
+}
+
+void ConstelTrainer::AdvanceScatterGather(int key) {
+  auto* state = GetKeyState(key);
+  auto& sg = state->scatter_gather;
+  if (!sg.started) {
+    return;
+  }
+  auto group = GetScatterGroup();
+  size_t num = group.size();
+  size_t me = ScatterGroupIndex(group, myid());
+  auto& result = sg.result;
+  auto seg = PlanScatterSegment(key, result.size(), result.dtype, num, me);
+  // the first num - 1 segments in the inbox are of this round, a member
+  // can be one round ahead
+  while (sg.num_scattered + 1 < num && !sg.inbox.empty()) {
+    const auto& value = sg.inbox.front();
+    CHECK_EQ(value.size(), seg.size);
+    ParallelSum(
+        result.data() + seg.offset, value.data(), seg.size, result.dtype);
+    sg.inbox.pop_front();
+    sg.num_scattered++;
+  }
+  if (!sg.gathering && sg.num_scattered + 1 == num) {
+    sg.gathering = true;
+    ps::SArray<ps::Key> keys({static_cast<ps::Key>(key)});
+    auto vals = ps::SArray<char>(result).segment(seg.offset,
+                                                 seg.offset + seg.size);
+    ps::SArray<uint64_t> lens({static_cast<uint64_t>(seg.size)});
+    int cmd = GetCommandType(RequestType::kAllGather, result.dtype);
+    for (size_t i = 0; i < num; ++i) {
+      if (i != me) {
+        trainer_->ZMove(group[i], keys, vals, lens, "", cmd);
+      }
+    }
+  }
+  if (sg.gathering && sg.num_gathered + 1 == num) {
+    state->update_buf.merged = result;
+    sg.started = false;
+    sg.gathering = false;
+    sg.num_scattered = 0;
+    sg.num_gathered = 0;
+    FinishPushPull(key);
+  }
+}
+
+void ConstelTrainer::FinishPushPull(int key) {
+  PendingPushPull pending;
+  {
+    std::lock_guard<std::mutex> lock(pending_pushpull_mu_);
+    auto it = pending_pushpull_.find(key);
+    CHECK(it != pending_pushpull_.end()) << "no PushPull of key " << key;
+    pending = std::move(it->second);
+    pending_pushpull_.erase(it);
+  }
+  auto* state = GetKeyState(key);
+  auto* buf = &state->update_buf;
+  // the children get the compressed result as is, the merge buffer the
+  // decompressed one
+  CArray response = buf->merged;
+  if (!state->compressed_result.isNone()) {
+    response = std::move(state->compressed_result);
+    state->compressed_result = CArray();
+    size_t size = Compressor::DecompressedSize(response);
+    buf->merged = buf->MergeBuf(
+        size, static_cast<int>(ConstelDataType::CONSTEL_FLOAT32));
+    GetCompressor(key, false)->Decompress(response, &buf->merged);
+  }
+  // put pullback data to the output from the update buf
+  if (pending.adopt) {
+    *pending.out = buf->merged;
+  } else if (pending.out->data() != buf->merged.data()) {
+    pending.out->CopyFrom(buf->merged);
+  }
+  // 2. 用记录的meta去回复子节点，带上pull回来的数据
+  auto metas = std::move(buf->answer_meta);
+  buf->answer_meta.clear();
+  for (const auto& meta : metas) {
+    ps::KVPairs<char> pairs;
+    pairs.keys.push_back(key);
+    pairs.vals = ps::SArray<char>(response);
+    auto len = static_cast<int>(response.size());  // bytes
+    pairs.lens = {len};
+    trainer_->Response(meta, pairs);
+  }
+  if (state->tree > 0) {
+    // the children on an extra tree made no request, the result is sent.
+    // They only push again after it arrived, so the buffer outlives it.
+    ps::SArray<ps::Key> keys({static_cast<ps::Key>(key)});
+    auto vals = ps::SArray<char>(response);
+    ps::SArray<uint64_t> lens({static_cast<uint64_t>(response.size())});
+    int cmd = GetCommandType(RequestType::kTreeResult, response.dtype);
+    auto extra = MakeTreeExtra(state->tree, clock_.getLocalTimestamp());
+    for (int child : GetTreeLinks(state->tree).children) {
+      trainer_->ZMove(child, keys, vals, lens, extra, cmd);
     }
   }
+  if (pending.on_done) {
+    pending.on_done();
+  }
+  for (auto part : pending.parts) {
+    pending.handle->MarkDone(part);
+  }
 }
 
 int ConstelTrainer::SimplePushPullDefault(int key, const CArray& val) {
@@ -351,29 +941,142 @@ int ConstelTrainer::SimplePushPullDefault(int key, const CArray& val) {
 }
 
 void ConstelTrainer::InitEngine(size_t num_thread = 8) {
+  CHECK_GT(num_thread, 0);
+  int64_t chunk = get_env("CONSTEL_REDUCE_CHUNK_BYTES", reduce_chunk_bytes_);
+  CHECK_GT(chunk, 0);
+  // keep the chunks a multiple of the cache line, so every dtype is aligned
+  reduce_chunk_bytes_ = std::max<size_t>(64, chunk / 64 * 64);
+  rebalance_interval_ =
+      get_env("CONSTEL_REBALANCE_INTERVAL", rebalance_interval_);
+  int64_t fusion_bytes =
+      get_env("CONSTEL_FUSION_BUCKET_BYTES", fusion_bucket_bytes_);
+  CHECK_GE(fusion_bytes, 0);
+  fusion_bucket_bytes_ = fusion_bytes;
+  int64_t pipeline_bytes =
+      get_env("CONSTEL_PIPELINE_CHUNK_BYTES", pipeline_chunk_bytes_);
+  CHECK_GE(pipeline_bytes, 0);
+  pipeline_chunk_bytes_ = pipeline_bytes;
+  compressor_spec_ = get_env_str("CONSTEL_COMPRESSOR", compressor_spec_);
+  // fail early on a bad spec
+  CompressorFactory::CreateCompressor(compressor_spec_, false);
+  int64_t compress_min_bytes =
+      get_env("CONSTEL_COMPRESS_MIN_BYTES", compress_min_bytes_);
+  CHECK_GE(compress_min_bytes, 0);
+  compress_min_bytes_ = compress_min_bytes;
+  compress_error_feedback_ =
+      get_env("CONSTEL_COMPRESS_ERROR_FEEDBACK", compress_error_feedback_);
+  int64_t scatter_min_bytes =
+      get_env("CONSTEL_SCATTER_MIN_BYTES", scatter_min_bytes_);
+  CHECK_GE(scatter_min_bytes, 0);
+  scatter_min_bytes_ = scatter_min_bytes;
+  int64_t migrate_chunk_bytes =
+      get_env("CONSTEL_MIGRATE_CHUNK_BYTES", migrate_chunk_bytes_);
+  CHECK_GE(migrate_chunk_bytes, 0);
+  migrate_chunk_bytes_ = migrate_chunk_bytes;
+  int64_t migrate_window = get_env("CONSTEL_MIGRATE_WINDOW", migrate_window_);
+  CHECK_GT(migrate_window, 0);
+  migrate_window_ = migrate_window;
+  migrate_delta_ = get_env("CONSTEL_MIGRATE_DELTA", migrate_delta_);
+  migrate_async_ = get_env("CONSTEL_MIGRATE_ASYNC", migrate_async_);
+  if (migrate_async_) {
+    migrate_thread_ = std::make_unique<std::thread>(
+        &ConstelTrainer::MigrateLoop, this);
+  }
   engine_ = new EngineType(num_thread);
   using namespace std::placeholders;
   engine_->set_data_handle(
       std::bind(&ConstelTrainer::ProcessPushData, this, _1, _2, _3));
-  //  engine_->set_messure_func();
+  // the load of a key is its size in KB, the reduction is bandwidth bound
+  engine_->set_messure_func([](int key, const EngineTaskData& data) {
+    return static_cast<int>(
+        std::max<size_t>(1, data.update_buf.merged.size() >> 10));
+  });
   engine_->Start();
 }
 
+/**
+ * \brief the extra of a PushPull request: the timestamp, followed by
+ * ",priority" if it is not 0. A plain timestamp still parses.
+ */
+static std::string MakePushExtra(uint32_t timestamp, int priority) {
+  if (priority == 0) {
+    return std::to_string(timestamp);
+  }
+  return std::to_string(timestamp) + "," + std::to_string(priority);
+}
+
+static void ParsePushExtra(const std::string& extra,
+                           uint32_t* timestamp,
+                           int* priority) {
+  auto pos = extra.find(',');
+  *timestamp = extra.empty() ? 0 : std::stoi(extra.substr(0, pos));
+  if (priority) {
+    *priority = pos == std::string::npos ? 0 : std::stoi(extra.substr(pos + 1));
+  }
+}
+
+void ConstelTrainer::ParallelSum(void* dst,
+                                 const void* src,
+                                 size_t len,
+                                 int dtype) {
+  ParallelSum(dst, dst, src, len, dtype);
+}
+
+void ConstelTrainer::ParallelSum(void* dst,
+                                 const void* src1,
+                                 const void* src2,
+                                 size_t len,
+                                 int dtype) {
+  size_t num_chunks = (len + reduce_chunk_bytes_ - 1) / reduce_chunk_bytes_;
+  if (num_chunks <= 1) {
+    reducer::Sum(dst, src1, src2, len, dtype);
+    return;
+  }
+  auto* dst_ptr = static_cast<char*>(dst);
+  auto* src1_ptr = static_cast<const char*>(src1);
+  auto* src2_ptr = static_cast<const char*>(src2);
+  size_t chunk = reduce_chunk_bytes_;
+  engine_->ParallelFor(num_chunks, [=](size_t i) {
+    size_t offset = i * chunk;
+    size_t size = std::min(chunk, len - offset);
+    reducer::Sum(
+        dst_ptr + offset, src1_ptr + offset, src2_ptr + offset, size, dtype);
+  });
+}
+
 void ConstelTrainer::ProcessPushData(
     const int key,
     const EngineTaskData& data,
     std::shared_ptr<ReturnOnAgg<EngineTaskData, int>> rt) {
+  if (data.type == TaskTypeEnum::kReduceScatter ||
+      data.type == TaskTypeEnum::kAllGather) {
+    // messages of the scatter group are not pushes of the round
+    ProcessScatterGather(key, data);
+    (*rt)(0);
+    return;
+  }
   auto& update = data.update_buf;
   auto update_buf = GetUpdateBuf(key);
   auto now = clock_.getLocalTimestamp();
+  // a message sent under a topology this node has not switched to yet waits
+  // for it, the extra trees carry the timestamp outside the request meta
+  uint32_t timestamp = data.timestamp;
   if (!update.request_meta.empty() && update.request_meta[0].extra.size() > 0 &&
-      data.type == TaskTypeEnum::kPushPull) {
-    uint32_t timestamp = std::stoi(update.request_meta[0].extra);
-    if (timestamp > now) {
-      std::lock_guard<std::mutex> lock(cached_kv_mu_);
-      cached_kv_[timestamp].push_back({key, data});
-      return;
-    }
+      data.type != TaskTypeEnum::kBroadcastDefault) {
+    ParsePushExtra(update.request_meta[0].extra, &timestamp, nullptr);
+  }
+  if (timestamp > now) {
+    std::lock_guard<std::mutex> lock(cached_kv_mu_);
+    cached_kv_[timestamp].push_back({key, data});
+    return;
+  }
+  if (data.type == TaskTypeEnum::kTreeResult) {
+    // adopted as is, like a pulled value
+    update_buf->merged = update.merged;
+    GetKeyState(key)->tree_push = CArray();
+    (*rt)(0);
+    FinishPushPull(key);
+    return;
   }
   int all_recved = ps::Postoffice::Get()->GetMyChildren().size() + 1;
   auto& tasktype = data.type;
@@ -387,17 +1090,11 @@ void ConstelTrainer::ProcessPushData(
     case TaskTypeEnum::kBroadcastDefault: {
       if (!update.merged.isNone()) {
         // init request from myself
-        // if (update_buf->merged.isNone() || update_buf->merged.size() !=
-        // update.merged.size()) {
-        //   update_buf->merged =
-        //   CArray(update.merged.size(),update.merged.dtype);  // alloc the
-        //   space
-        // }
-        update_buf->merged = CArray(update.merged.size(), update.merged.dtype);
+        update_buf->merged =
+            update_buf->MergeBuf(update.merged.size(), update.merged.dtype);
         if (data.isFromRoot) {
           update_buf->merged.CopyFrom(update.merged);
-          std::lock_guard<std::mutex> lock(init_waiting_ts_mu_);
-          init_waiting_ts_[key] = -1;
+          GetKeyState(key)->init_waiting_ts = -1;
         } else {
           // pull request to father
           auto key_t = ps::SArray<ps::Key>({static_cast<ps::Key>(key)});
@@ -411,22 +1108,14 @@ void ConstelTrainer::ProcessPushData(
             delete vals;
             delete len_t;
           });
-
-          {
-            std::lock_guard<std::mutex> lock(init_waiting_ts_mu_);
-            init_waiting_ts_[key] = ts;
-          }
+          GetKeyState(key)->init_waiting_ts = ts;
         }
       } else {
         // init request from sons
       }
       if (update_buf->num == all_recved) {
         update_buf->shouldReset = true;
-        int ts;
-        {
-          std::lock_guard<std::mutex> lock(init_waiting_ts_mu_);
-          ts = init_waiting_ts_[key];
-        }
+        int ts = GetKeyState(key)->init_waiting_ts;
         if (ts != -1) {
           trainer_->Wait(ts);
         }
@@ -444,42 +1133,134 @@ void ConstelTrainer::ProcessPushData(
       break;
     }
     case TaskTypeEnum::kPushPull: {
+      // a compressed push of a child is decompressed before the reduction
+      CArray decoded;
+      if (data.compressed) {
+        GetCompressor(key, true)->Decompress(update.merged, &decoded);
+      }
+      const CArray& value = data.compressed ? decoded : update.merged;
+      // a key on an extra tree is reduced from the children there
+      TreeLinks links;
+      if (data.tree > 0) {
+        links = GetTreeLinks(data.tree);
+        all_recved = links.children.size() + 1;
+      }
+      GetKeyState(key)->tree = data.tree;
+      // in a scatter group the children of the root reduce-scatter with it
+      // instead of pushing to it, those outside the group still push
+      bool scatter =
+          data.tree == 0 && UseScatterGather(value.size(), value.dtype);
+      if (scatter && isRootNode()) {
+        auto group = GetScatterGroup();
+        all_recved = 1;
+        for (int child : ps::Postoffice::Get()->GetMyChildren()) {
+          all_recved += !std_isin(child, group);
+        }
+      }
       if (update_buf->num == 1) {
-        // if (update_buf->merged.isNone() || update_buf->merged.size() !=
-        // update.merged.size()) {
-        //   update_buf->merged = CArray(update.merged.size());  // alloc the
-        //   space
-        // }
-        update_buf->merged = CArray(update.merged.size());
-        // copy the val into merged
-        update_buf->merged.CopyFrom(update.merged);
+        // only keep a reference to the first value, it is summed straight
+        // from its (network) buffer once the second one arrives
+        update_buf->first = value;
+      } else if (update_buf->num == 2) {
+        auto& first = update_buf->first;
+        CHECK_EQ(first.size(), value.size());
+        CHECK_EQ(first.dtype, value.dtype);
+        update_buf->merged = update_buf->MergeBuf(first.size(), first.dtype);
+        ParallelSum(update_buf->merged.data(),
+                    first.data(),
+                    value.data(),
+                    value.size(),
+                    value.dtype);
+        first = CArray();
       } else {
-        // TODO: Use Template to replace this
-        auto dst = reinterpret_cast<float*>(update_buf->merged.data());
-        auto src = reinterpret_cast<float*>(update.merged.data());
-        // TODO: Use omp
-        CHECK_EQ(update_buf->merged.size(), update.merged.size());
-        for (size_t i = 0; i < update_buf->merged.size() / sizeof(float); i++) {
-          dst[i] += src[i];
-        }
+        CHECK_EQ(update_buf->merged.size(), value.size());
+        CHECK_EQ(update_buf->merged.dtype, value.dtype);
+        ParallelSum(update_buf->merged.data(),
+                    value.data(),
+                    value.size(),
+                    value.dtype);
       }
 
       if (update_buf->num == all_recved) {
-        std::string dbg;
-        for (const auto& meta : update_buf->request_meta) {
-          dbg += std::to_string(meta.sender) + " ";
-        }
-        update_buf->shouldReset = true;
+        // a single contributor is pushed as is, the result gets its own
+        // buffer since the pull writes into it
+        CArray push_val = update_buf->num == 1 ? update_buf->first
+                                               : update_buf->merged;
+        update_buf->first = CArray();
+        update_buf->CompleteRound();
+        bool compress = ShouldCompress(push_val.size(), push_val.dtype);
         // send to father
-        // TODO: int dtype = what...
-        if (isRootNode()) {
+        if (data.tree > 0) {
+          (*rt)(0);
+          if (links.parent == 0) {
+            update_buf->merged = push_val;
+            FinishPushPull(key);
+          } else {
+            // the parent sends the result once it is reduced
+            auto* state = GetKeyState(key);
+            state->tree_push = push_val;
+            ps::SArray<ps::Key> keys({static_cast<ps::Key>(key)});
+            ps::SArray<uint64_t> lens(
+                {static_cast<uint64_t>(push_val.size())});
+            int cmd =
+                GetCommandType(RequestType::kTreePushPull, push_val.dtype);
+            trainer_->ZMove(links.parent,
+                            keys,
+                            ps::SArray<char>(state->tree_push),
+                            lens,
+                            MakeTreeExtra(data.tree, now),
+                            cmd);
+          }
+        } else if (scatter) {
+          (*rt)(0);
+          StartScatterGather(key, push_val);
+        } else if (isRootNode()) {
           // for root node, no need to send, just rt(0)
+          update_buf->merged = push_val;
+          if (compress) {
+            // every node decodes the same bytes, so the root also uses the
+            // decompressed result
+            GetCompressor(key, false)->Compress(
+                push_val, &GetKeyState(key)->compressed_result);
+          }
           (*rt)(0);
+          FinishPushPull(key);
+        } else if (compress) {
+          // the parent answers with the compressed result, of a size only
+          // known when it arrives
+          auto* state = GetKeyState(key);
+          GetCompressor(key, true)->Compress(push_val, &state->compressed_push);
+          auto push_vals = ps::SArray<char>(state->compressed_push);
+          auto vals = new ps::SArray<char>();
+          auto key_t = static_cast<ps::Key>(key);
+          ps::SArray<ps::Key> keys({key_t});
+          auto lens = new ps::SArray<uint64_t>(
+              {static_cast<uint64_t>(push_vals.size())});
+          int cmd = GetCommandType(RequestType::kCompressedPushPull,
+                                   push_val.dtype);
+          int ts = trainer_->ZPushPull(
+              keys,
+              push_vals,
+              vals,
+              lens,
+              cmd,
+              MakePushExtra(now, data.priority),
+              [this, key, state, vals, lens]() {
+                state->compressed_result =
+                    CArray(vals->ptr(), vals->data(), vals->size(), 0);
+                delete vals;
+                delete lens;
+                FinishPushPull(key);
+              });
+          (*rt)(ts);
         } else {
-          // ps::SArray vals's initialization will create the shared_ptr from
-          // the data ptr, and CArray also hold the shared_ptr of the data, So
-          // here `deletable` must be false. or may cause double free
-          // TODO: use another buff to recv
+          if (update_buf->num == 1) {
+            update_buf->merged =
+                update_buf->MergeBuf(push_val.size(), push_val.dtype);
+          }
+          // neither SArray owns the memory, push_val and the update buf keep
+          // it alive until the callback
+          auto push_vals = ps::SArray<char>(push_val);
           auto vals = new ps::SArray<char>(update_buf->merged);
           auto key_t = static_cast<ps::Key>(key);
           ps::SArray<ps::Key> keys({key_t});
@@ -488,20 +1269,64 @@ void ConstelTrainer::ProcessPushData(
           int cmd = GetCommandType(RequestType::kDefaultPushPull,
                                    update_buf->merged.dtype);
           int ts = trainer_->ZPushPull(keys,
-                                       *vals,
+                                       push_vals,
                                        vals,
                                        lens,
                                        cmd,
-                                       std::to_string(now),
-                                       [vals, lens]() {
+                                       MakePushExtra(now, data.priority),
+                                       [this, key, vals, lens, push_val]() {
                                          delete vals;
                                          delete lens;
+                                         FinishPushPull(key);
                                        });
           (*rt)(ts);
         }
       }
       break;
     }
+    case TaskTypeEnum::kRowSparsePushPull: {
+      // the rows are merged by row id, a merge always gives a new buffer
+      if (update_buf->num == 1) {
+        update_buf->merged = update.merged;
+      } else {
+        update_buf->merged = MergeRowSparse(update_buf->merged, update.merged);
+      }
+      if (update_buf->num == all_recved) {
+        update_buf->CompleteRound();
+        if (isRootNode()) {
+          (*rt)(0);
+          FinishPushPull(key);
+        } else {
+          // the father answers with the union of the rows of the whole tree,
+          // of a size only known when it arrives
+          CArray push_val = update_buf->merged;
+          auto push_vals = ps::SArray<char>(push_val);
+          auto vals = new ps::SArray<char>();
+          auto key_t = static_cast<ps::Key>(key);
+          ps::SArray<ps::Key> keys({key_t});
+          auto lens = new ps::SArray<uint64_t>(
+              {static_cast<uint64_t>(push_vals.size())});
+          int cmd = GetCommandType(RequestType::kRowSparsePushPull,
+                                   push_val.dtype);
+          int ts = trainer_->ZPushPull(
+              keys,
+              push_vals,
+              vals,
+              lens,
+              cmd,
+              MakePushExtra(now, data.priority),
+              [this, key, update_buf, vals, lens, push_val]() {
+                update_buf->merged = CArray(
+                    vals->ptr(), vals->data(), vals->size(), push_val.dtype);
+                delete vals;
+                delete lens;
+                FinishPushPull(key);
+              });
+          (*rt)(ts);
+        }
+      }
+      break;
+    }
     default:
       LOG(FATAL) << "unsupported task type";
   }
@@ -532,13 +1357,24 @@ void ConstelTrainer::RequestHandle(const ps::SimpleData& recved,
           CHECK(it != transtopo.end())
               << "Node " << my_id << " is not in the transtopo";
         }
+        if (it != transtopo.end() &&
+            tick.migrate_phase == ScaleClock::Tick::kMigrateCatchUp) {
+          // the ticks of the old nodes are sent after this one, so nothing
+          // has arrived yet: expect the snapshot and then the catch-up
+          std::lock_guard<std::mutex> lock(model_sync_mu_);
+          for (const auto& [key, len] : model_info_) {
+            model_size_ += len;
+          }
+        }
         if (it != transtopo.end()) {
           this->clock_.local_timestamp_ = fut_timestamp;
           auto& local_transtopo = it->second;
           this->SetNodeTransTopo(local_transtopo);
           PS_VLOG(2) << "Update transtopo: " << local_transtopo.debug_string();
           // notify main thread
+          std::lock_guard<std::mutex> lock(ctx_ready_mu_);
           this->is_ctx_ready_.store(true);
+          ctx_ready_cv_.notify_all();
         }
       } else {
         // for old nodes
@@ -590,21 +1426,63 @@ void ConstelTrainer::DataHandle(const ps::KVMeta& req_meta,
   auto& updt = data.update_buf;
   switch (type.requestType) {
     case RequestType::kDefaultPushPull:
+    case RequestType::kCompressedPushPull:
+    case RequestType::kRowSparsePushPull: {
       updt.request_meta.push_back(req_meta);
-      updt.merged = CArray(req_data.lens[0]);
-      // TODO: 先数据拷贝一份，有优化空间
-      updt.merged.CopyFrom((void*)req_data.vals.data(), req_data.lens[0]);
+      data.compressed =
+          type.requestType == RequestType::kCompressedPushPull;
+      if (type.requestType == RequestType::kRowSparsePushPull) {
+        data.type = TaskTypeEnum::kRowSparsePushPull;
+      }
+      // share the received buffer instead of copying it
+      updt.merged = CArray(req_data.vals.ptr(),
+                           req_data.vals.data(),
+                           req_data.lens[0],
+                           type.dtype);
+      uint32_t timestamp;
+      ParsePushExtra(req_meta.extra, &timestamp, &data.priority);
+      engine_->PushAsync(
+          {static_cast<int>(req_data.keys[0])}, {data}, {data.priority});
+      break;
+    }
+    case RequestType::kReduceScatter:
+    case RequestType::kAllGather: {
+      data.type = type.requestType == RequestType::kReduceScatter
+                      ? TaskTypeEnum::kReduceScatter
+                      : TaskTypeEnum::kAllGather;
+      updt.merged = CArray(req_data.vals.ptr(),
+                           req_data.vals.data(),
+                           req_data.lens[0],
+                           type.dtype);
+      data.segment = ScatterGroupIndex(GetScatterGroup(), req_meta.sender);
       engine_->PushAsync({static_cast<int>(req_data.keys[0])}, {data});
+      trainer->Response(req_meta, {});
       break;
+    }
+    case RequestType::kTreePushPull:
+    case RequestType::kTreeResult: {
+      if (type.requestType == RequestType::kTreeResult) {
+        data.type = TaskTypeEnum::kTreeResult;
+      }
+      updt.merged = CArray(req_data.vals.ptr(),
+                           req_data.vals.data(),
+                           req_data.lens[0],
+                           type.dtype);
+      ParseTreeExtra(req_meta.extra, &data.tree, &data.timestamp);
+      engine_->PushAsync({static_cast<int>(req_data.keys[0])}, {data});
+      trainer->Response(req_meta, {});
+      break;
+    }
     case RequestType::kDefaultInit:
       updt.request_meta.push_back(req_meta);
       data.type = TaskTypeEnum::kBroadcastDefault;
-      //      updt.merged = CArray(req_data.lens[0]);
+      //      updt.merged = CArray(req_data.lens[0], type.dtype);
       //      updt.merged.CopyFrom((void*)req_data.vals.data(),
       //      req_data.lens[0]);
       engine_->PushAsync({static_cast<int>(req_data.keys[0])}, {data});
       break;
     case RequestType::kModelSync:
+    case RequestType::kModelSyncDelta:
       if (req_meta.extra.empty()) {
         LOG(WARNING) << "ModelSync request has no extra";
         break;
@@ -621,32 +1499,39 @@ void ConstelTrainer::DataHandle(const ps::KVMeta& req_meta,
           model_sync_conf.target_node_id[0] ==
               ps::Postoffice::Get()->GetMyID()) {
         // recv the data
-        std::unique_lock<std::mutex> lock(model_sync_mu_);
-        while (wait_recv_keys_ == nullptr) {
-          lock.unlock();
-          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-          lock.lock();
+        const auto& kvslice = model_sync_conf.kvslices[0][0];
+        CArray* dst = nullptr;
+        {
+          std::unique_lock<std::mutex> lock(model_sync_mu_);
+          model_sync_cv_.wait(lock, [this] { return recv_posted_; });
+          auto it = recv_bufs_.find(kvslice.key_begin);
+          if (it != recv_bufs_.end()) {
+            dst = it->second;
+          }
         }
-        CHECK_EQ(wait_recv_keys_->size(), wait_recv_vals_->size());
-        auto idx =
-            std::distance(wait_recv_keys_->begin(),
-                          std::find(wait_recv_keys_->begin(),
-                                    wait_recv_keys_->end(),
-                                    model_sync_conf.kvslices[0][0].key_begin));
-        if (idx < wait_recv_keys_->size()) {
-          auto size = req_data.vals.size();
-          CHECK_EQ(req_data.lens[0], size);
-          if (model_sync_conf.kvslices[0][0].is_full()) {
-            // TODO: This can be zero copy
-            wait_recv_vals_->at(idx)->CopyFrom(req_data.vals.data(), size);
+        if (dst) {
+          CHECK_EQ(req_data.lens[0], req_data.vals.size());
+          uint64_t offset = kvslice.is_full() ? 0 : kvslice.slice;
+          uint64_t size = kvslice.is_full() ? dst->size() : kvslice.slice_len;
+          CHECK_LE(offset + size, dst->size());
+          // straight into the posted buffer without a lock: the slices of a
+          // key do not overlap, except a catch-up with the slice it corrects.
+          // That one was sent before it on the same path, relays forward in
+          // order and the messages are handled one at a time by the receive
+          // thread, so the catch-up always applies after it
+          if (type.requestType == RequestType::kModelSyncDelta) {
+            // a catch-up: the change since the slice that came first on the
+            // same path, so it is already in the buffer
+            CArray delta(req_data.vals.ptr(),
+                         req_data.vals.data(),
+                         req_data.vals.size(),
+                         type.dtype);
+            ApplyMigrateDelta(delta, dst->data() + offset, size);
           } else {
-            CHECK_EQ(req_data.lens[0],
-                     model_sync_conf.kvslices[0][0].slice_len);
-            wait_recv_vals_->at(idx)->CopyFrom(
-                req_data.vals.data(),
-                size,
-                model_sync_conf.kvslices[0][0].slice);
+            CHECK_EQ(req_data.vals.size(), size);
+            dst->CopyFrom(req_data.vals.data(), size, offset);
           }
+          std::lock_guard<std::mutex> lock(model_sync_mu_);
           if (model_size_ < size) {
             LOG(FATAL) << "model_size_ is less than 0";
           } else {
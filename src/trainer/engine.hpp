@@ -1,12 +1,23 @@
 #ifndef CONSTELLATION_ENGINE_H_
 #define CONSTELLATION_ENGINE_H_
 
-#include "ps/internal/threadsafe_queue.h"
+#include "dmlc/logging.h"
+#include "../utils/key_table.hpp"
+#include "../utils/mpsc_queue.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <future>
 
 namespace constellation {
@@ -36,7 +47,7 @@ class ConstelAggEngine {
   using DataHandle = std::function<
       void(const int, const Data&, std::shared_ptr<ReturnOnAggType>)>;
 
-  using MessureFunc = std::function<int(int, Data)>;
+  using MessureFunc = std::function<int(int, const Data&)>;
 
   void set_data_handle(const DataHandle& handle) {
     CHECK(handle);
@@ -73,6 +84,8 @@ class ConstelAggEngine {
   void CallBackReturnHandle(ConstelAggEngine* engine,
                             const int id,
                             const ResType& res) {
+    // the cost is in before anyone waiting for the return can Rebalance
+    engine->RecordCost(id);
     std::unique_lock<std::mutex> lock(engine->return_mu_);
     if (engine->expected_ids_.count(id) != 0) {
       if (engine->res_ptr_) {
@@ -89,25 +102,21 @@ class ConstelAggEngine {
 
   void Start() {
     is_running_ = true;
+    stop_ = false;
     for (size_t i = 0; i < num_threads_; ++i) {
-      auto queue = std::make_unique<ps::ThreadsafeQueue<Task>>();
-      queues_.emplace_back(std::move(queue));
-      threads_.emplace_back([this, i]() {
-        while (true) {
-          Task task;
-          this->queues_[i]->WaitAndPop(&task);
-          if (!task)
-            break;
-          task();
-        }
-      });
+      workers_.emplace_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < num_threads_; ++i) {
+      threads_.emplace_back([this, i]() { this->WorkerLoop(i); });
     }
   }
   void Stop() {
     is_running_ = false;
-    for (auto& queue : queues_) {
-      queue->Push(Task());
+    {
+      std::lock_guard<std::mutex> lock(idle_mu_);
+      stop_ = true;
     }
+    idle_cv_.notify_all();
     for (auto& thread : threads_) {
       if (thread.joinable())
         thread.join();
@@ -115,42 +124,371 @@ class ConstelAggEngine {
   }
   void PushAndWait(const std::vector<int>& ids,
                    std::vector<Data>&& data,
-                   std::unordered_map<int, ResType>* ret) {
+                   std::unordered_map<int, ResType>* ret,
+                   const std::vector<int>& priorities = {}) {
     CHECK(is_running_);
-    expected_ids_ = std::unordered_set<int>(ids.begin(), ids.end());
-    // the data not pushed yet, so other thread will execute the return callback
-    // so we can
-    res_ptr_ = ret;
-    if (res_ptr_) {
-      for (auto i : expected_ids_) {
-        res_ptr_->emplace(i, ResType());
+    {
+      // tasks pushed by PushAsync may return at any time
+      std::lock_guard<std::mutex> lock(return_mu_);
+      expected_ids_ = std::unordered_set<int>(ids.begin(), ids.end());
+      // the data not pushed yet, so other thread will execute the return
+      // callback so we can
+      res_ptr_ = ret;
+      if (res_ptr_) {
+        for (auto i : expected_ids_) {
+          res_ptr_->emplace(i, ResType());
+        }
       }
     }
 
-    PushAsync(ids, std::move(data));
+    PushAsync(ids, std::move(data), priorities);
     std::unique_lock<std::mutex> return_mu(return_mu_);
     return_cv_.wait(return_mu,
                     [this]() { return num_ready_ == expected_ids_.size(); });
     expected_ids_.clear();
     num_ready_ = 0;
   }
-  void PushAsync(const std::vector<int>& ids, std::vector<Data>&& data) {
+  /**
+   * \brief run fn(0) ... fn(n - 1) on the engine threads and return when all
+   * of them are done. The calling thread, usually an engine thread inside the
+   * DataHandle, claims chunks as well, so this never waits for a busy queue.
+   */
+  void ParallelFor(size_t n, const std::function<void(size_t)>& fn) {
+    CHECK(is_running_);
+    if (n == 0)
+      return;
+    if (n == 1 || num_threads_ == 1) {
+      for (size_t i = 0; i < n; ++i)
+        fn(i);
+      return;
+    }
+    // the helpers may be popped after the caller returned, so the state they
+    // touch is shared and `fn` is only called for a claimed chunk
+    struct ParallelState {
+      std::function<void(size_t)> fn;
+      size_t n;
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> done{0};
+      std::mutex mu;
+      std::condition_variable cv;
+    };
+    auto state = std::make_shared<ParallelState>();
+    state->fn = fn;
+    state->n = n;
+    auto run = [](ParallelState* st) {
+      size_t i;
+      while ((i = st->next.fetch_add(1)) < st->n) {
+        st->fn(i);
+        if (st->done.fetch_add(1) + 1 == st->n) {
+          std::lock_guard<std::mutex> lock(st->mu);
+          st->cv.notify_all();
+        }
+      }
+    };
+    size_t num_helpers = std::min(n - 1, num_threads_);
+    // helpers join an reduction already running, ahead of any queued key
+    for (size_t i = 0; i < num_helpers; ++i) {
+      PushTask(i, std::numeric_limits<int>::max(), [state, run]() {
+        run(state.get());
+      });
+    }
+    run(state.get());
+    std::unique_lock<std::mutex> lock(state->mu);
+    state->cv.wait(lock, [&state]() { return state->done.load() == state->n; });
+  }
+
+  size_t num_threads() const {
+    return num_threads_;
+  }
+
+  /**
+   * \brief queue `data` for the DataHandle. Keys with a higher priority are
+   * handled first, keys of equal priority in push order. Tasks of the same
+   * key always run in push order.
+   */
+  void PushAsync(const std::vector<int>& ids,
+                 std::vector<Data>&& data,
+                 const std::vector<int>& priorities = {}) {
     CHECK(is_running_);
     CHECK_EQ(ids.size(), data.size());
+    CHECK(priorities.empty() || priorities.size() == ids.size());
     for (size_t i = 0; i < ids.size(); ++i) {
       int id = ids[i];
       auto d = std::make_shared<Data>(std::move(data[i]));
-      size_t tid = GetWorkerId(id, d.get());
-      queues_[tid]->Push([this, d, id]() {
+      Strand* strand = GetStrand(id, d.get());
+      strand->priority = priorities.empty() ? 0 : priorities[i];
+      strand->load += messure_func_ ? messure_func_(id, *d) : 1;
+      strand->pending.Push([this, d, id]() {
         auto callback = CreateReturnCallBack(id);
         this->datahandle_(id, *d, callback);
       });
+      // pairs with the fence in RunStrand, either the runner sees this task
+      // or we see the strand idle and schedule it
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (strand->scheduled.exchange(true))
+        continue;
+      ScheduleStrand(strand);
+    }
+  }
+
+  struct LoadStats {
+    size_t num_rebalances = 0;
+    size_t num_moved_keys = 0;
+    /** \brief measured cost per thread in the last window, after rebalance */
+    std::vector<uint64_t> thread_cost_ns;
+    std::unordered_map<int, size_t> key_to_thread;
+  };
+
+  /**
+   * \brief reassign keys to threads by the cost measured since the last call
+   * (longest first, each to the least loaded thread). The assignment only
+   * changes if it lowers the busiest thread's cost by more than
+   * `tolerance`, so noise does not shuffle keys every batch. Waits for the
+   * running tasks to be timed, so it must not be called from a task.
+   * \return the number of keys that moved to another thread
+   */
+  size_t Rebalance(double tolerance = 0.1) {
+    struct KeyCost {
+      int id;
+      Strand* strand;
+      uint64_t cost_ns;
+      int64_t load;
+    };
+    std::vector<KeyCost> costs;
+    strands_.ForEach([&costs](int id, Strand* strand) {
+      // a task whose work completed a wait may still be returning, e.g. a
+      // PushPull answered before its task called back
+      while (strand->run_start_ns.load() != 0) {
+        std::this_thread::yield();
+      }
+      costs.push_back({id,
+                       strand,
+                       strand->cost_ns.exchange(0),
+                       strand->load.exchange(0)});
+    });
+    std::sort(costs.begin(),
+              costs.end(),
+              [](const KeyCost& a, const KeyCost& b) {
+                return a.cost_ns != b.cost_ns ? a.cost_ns > b.cost_ns :
+                                                a.id < b.id;
+              });
+    std::vector<uint64_t> current(num_threads_, 0), planned(num_threads_, 0);
+    std::vector<size_t> assignment(costs.size());
+    for (size_t i = 0; i < costs.size(); ++i) {
+      current[costs[i].strand->home] += costs[i].cost_ns;
+      auto least = std::min_element(planned.begin(), planned.end());
+      *least += costs[i].cost_ns;
+      assignment[i] = least - planned.begin();
     }
+    uint64_t current_max = *std::max_element(current.begin(), current.end());
+    uint64_t planned_max = *std::max_element(planned.begin(), planned.end());
+    bool apply = planned_max < current_max * (1 - tolerance);
+
+    size_t moved = 0;
+    std::lock_guard<std::mutex> lock(thread_id_mu_);
+    for (size_t i = 0; i < num_threads_; ++i) {
+      load_map_[i] = 0;
+    }
+    for (size_t i = 0; i < costs.size(); ++i) {
+      auto* strand = costs[i].strand;
+      if (apply && strand->home != assignment[i]) {
+        strand->home = assignment[i];
+        thread_id_map_[costs[i].id] = assignment[i];
+        ++moved;
+      }
+      load_map_[strand->home] += costs[i].load;
+    }
+    load_stats_.num_rebalances++;
+    load_stats_.num_moved_keys += moved;
+    load_stats_.thread_cost_ns = apply ? planned : current;
+    load_stats_.key_to_thread = thread_id_map_;
+    return moved;
+  }
+
+  LoadStats GetLoadStats() {
+    std::lock_guard<std::mutex> lock(thread_id_mu_);
+    return load_stats_;
+  }
+
+  /** \brief number of tasks taken from another thread's queue */
+  size_t num_steals() const {
+    return num_steals_.load();
   }
 
  private:
   using Task = std::function<void()>;
 
+  /** \brief max tasks queued per key before PushAsync waits */
+  static constexpr size_t kStrandCapacity = 128;
+
+  /**
+   * \brief tasks of one key, executed one at a time in push order. Only the
+   * strand is scheduled on a worker, so whichever thread runs (or steals) it
+   * keeps the per-key ordering of the DataHandle calls. The thread holding
+   * `scheduled` is the single consumer of `pending`.
+   */
+  struct alignas(64) Strand {
+    explicit Strand(size_t capacity) : pending(capacity) {}
+    MPSCQueue<Task> pending;
+    std::atomic<bool> scheduled{false};
+    std::atomic<size_t> home{0};
+    /** \brief priority of the latest push */
+    std::atomic<int> priority{0};
+    // measured since the last Rebalance
+    std::atomic<uint64_t> cost_ns{0};
+    std::atomic<int64_t> load{0};
+    /** \brief when the running task started to be timed, 0 if none runs */
+    std::atomic<int64_t> run_start_ns{0};
+  };
+
+  /** \brief the strand whose task this thread runs */
+  inline static thread_local Strand* running_strand_ = nullptr;
+
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /**
+   * \brief add the time the running task of key `id` took so far to its
+   * cost. A task returning from its own thread is done, the rest of it is
+   * not timed. One returning from another thread, e.g. on a response, may
+   * belong to an earlier task, so the running one is timed on.
+   */
+  void RecordCost(int id) {
+    Strand* strand = strands_.Find(id);
+    if (strand == nullptr) {
+      return;
+    }
+    int64_t now = NowNs();
+    int64_t start = strand->run_start_ns.load();
+    if (strand == running_strand_) {
+      start = strand->run_start_ns.exchange(0);
+    } else {
+      while (start != 0 &&
+             !strand->run_start_ns.compare_exchange_weak(start, now)) {
+      }
+    }
+    if (start != 0) {
+      strand->cost_ns += now - start;
+    }
+  }
+
+  struct QueuedTask {
+    int priority;
+    uint64_t seq;
+    Task task;
+
+    /** \brief heap order: higher priority first, then lower seq (FIFO) */
+    bool operator<(const QueuedTask& other) const {
+      return priority != other.priority ? priority < other.priority :
+                                          seq > other.seq;
+    }
+  };
+
+  /**
+   * \brief per-thread task heap. The owner and thieves both take the most
+   * urgent task, so priorities hold across threads.
+   */
+  struct Worker {
+    std::mutex mu;
+    std::vector<QueuedTask> tasks;
+  };
+
+  Strand* GetStrand(int id, const Data* data) {
+    // GetWorkerId gives the same thread for the same id, so a strand built
+    // by a losing racer is equivalent
+    return strands_.GetOrCreate(id, [this, id, data]() {
+      auto* strand = new Strand(kStrandCapacity);
+      strand->home = GetWorkerId(id, data);
+      return strand;
+    });
+  }
+
+  void RunStrand(Strand* strand) {
+    Task task;
+    if (strand->pending.TryPop(&task)) {
+      running_strand_ = strand;
+      strand->run_start_ns = NowNs();
+      task();
+      running_strand_ = nullptr;
+      int64_t start = strand->run_start_ns.exchange(0);
+      if (start != 0) {
+        strand->cost_ns += NowNs() - start;
+      }
+    }
+    // requeue behind the other keys of its home thread instead of draining
+    // the key, so a busy key does not starve its neighbours
+    if (!strand->pending.Empty()) {
+      ScheduleStrand(strand);
+      return;
+    }
+    strand->scheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // a producer may have pushed after the check above and seen us running
+    if (!strand->pending.Empty() && !strand->scheduled.exchange(true)) {
+      ScheduleStrand(strand);
+    }
+  }
+
+  void ScheduleStrand(Strand* strand) {
+    PushTask(strand->home, strand->priority, [this, strand]() {
+      RunStrand(strand);
+    });
+  }
+
+  void PushTask(size_t tid, int priority, Task&& task) {
+    {
+      auto& worker = *workers_[tid];
+      std::lock_guard<std::mutex> lock(worker.mu);
+      worker.tasks.push_back({priority, next_seq_++, std::move(task)});
+      std::push_heap(worker.tasks.begin(), worker.tasks.end());
+    }
+    {
+      std::lock_guard<std::mutex> lock(idle_mu_);
+      ++num_pending_;
+    }
+    idle_cv_.notify_one();
+  }
+
+  bool PopTop(Worker* worker, Task* task) {
+    std::lock_guard<std::mutex> lock(worker->mu);
+    if (worker->tasks.empty())
+      return false;
+    std::pop_heap(worker->tasks.begin(), worker->tasks.end());
+    *task = std::move(worker->tasks.back().task);
+    worker->tasks.pop_back();
+    --num_pending_;
+    return true;
+  }
+
+  bool PopOrSteal(size_t tid, Task* task) {
+    if (PopTop(workers_[tid].get(), task))
+      return true;
+    for (size_t k = 1; k < num_threads_; ++k) {
+      if (PopTop(workers_[(tid + k) % num_threads_].get(), task)) {
+        ++num_steals_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerLoop(size_t tid) {
+    while (true) {
+      Task task;
+      if (PopOrSteal(tid, &task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(idle_mu_);
+      idle_cv_.wait(lock, [this]() { return num_pending_ > 0 || stop_; });
+      if (stop_ && num_pending_ == 0)
+        break;
+    }
+  }
+
   size_t GetWorkerId(int id, const Data* data = nullptr) {
     return GetWorkerIdDefault(id, data);
   }
@@ -169,7 +507,7 @@ class ConstelAggEngine {
     int taskload = (data == nullptr || messure_func_ == nullptr) ?
                        1 :
                        messure_func_(id, *data);
-    int min_load = std::numeric_limits<int>::max();
+    int64_t min_load = std::numeric_limits<int64_t>::max();
     size_t min_load_id = 0;
     for (auto& load : load_map_) {
       if (load.second < min_load) {
@@ -186,7 +524,8 @@ class ConstelAggEngine {
 
   std::mutex thread_id_mu_;
   std::unordered_map<int, size_t> thread_id_map_;
-  std::unordered_map<size_t, int> load_map_;
+  std::unordered_map<size_t, int64_t> load_map_;
+  LoadStats load_stats_;
 
   std::mutex return_mu_;
   std::condition_variable return_cv_;
@@ -196,8 +535,17 @@ class ConstelAggEngine {
 
   bool is_running_;
   size_t num_threads_;
-  std::vector<std::unique_ptr<ps::ThreadsafeQueue<Task>>> queues_;
+  std::vector<std::unique_ptr<Worker>> workers_;
   std::vector<std::thread> threads_;
+
+  KeyTable<Strand> strands_;
+
+  std::mutex idle_mu_;
+  std::condition_variable idle_cv_;
+  std::atomic<size_t> num_pending_{0};
+  std::atomic<size_t> num_steals_{0};
+  std::atomic<uint64_t> next_seq_{0};
+  bool stop_ = false;
 };
 }  // namespace constellation
 
@@ -0,0 +1,228 @@
+#include "fusion.h"
+
+#include "dmlc/logging.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace constellation {
+
+std::vector<FusionBucket> PlanFusionBuckets(const std::vector<int>& keys,
+                                            const std::vector<CArray>& vals,
+                                            size_t bucket_bytes) {
+  CHECK_EQ(keys.size(), vals.size());
+  std::vector<FusionBucket> buckets;
+  FusionBucket* open = nullptr;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    CHECK_GE(keys[i], 0);
+    CHECK_LT(keys[i], kVirtualKeyBase) << "key " << keys[i] << " is reserved";
+    size_t size = vals[i].size();
+    bool small = size < bucket_bytes;
+    if (open && small && open->dtype == vals[i].dtype &&
+        open->size + size <= bucket_bytes) {
+      open->members.push_back(i);
+      open->offsets.push_back(open->size);
+      open->size += size;
+      open->key = kFusionKeyBase + keys[open->members[0]];
+      continue;
+    }
+    buckets.push_back({keys[i], vals[i].dtype, size, {i}, {0}});
+    open = small ? &buckets.back() : nullptr;
+  }
+  return buckets;
+}
+
+std::vector<KeyChunk> PlanKeyChunks(int key,
+                                    size_t size,
+                                    int dtype,
+                                    size_t chunk_bytes) {
+  if (chunk_bytes == 0 || size <= chunk_bytes) {
+    return {{key, 0, size}};
+  }
+  CHECK_GE(key, 0);
+  CHECK_LE(key, kMaxChunkedKey) << "key " << key << " is too large to chunk";
+  size_t num_chunks = (size + chunk_bytes - 1) / chunk_bytes;
+  if (num_chunks > kMaxKeyChunks) {
+    chunk_bytes = (size + kMaxKeyChunks - 1) / kMaxKeyChunks;
+  }
+  // the cache line is a multiple of every element size
+  size_t align = std::max<size_t>(64, GetDataTypeSize(dtype));
+  chunk_bytes = (chunk_bytes + align - 1) / align * align;
+  std::vector<KeyChunk> chunks;
+  for (size_t offset = 0; offset < size; offset += chunk_bytes) {
+    int part = static_cast<int>(chunks.size());
+    chunks.push_back({kChunkKeyBase + key * kMaxKeyChunks + part,
+                      offset,
+                      std::min(chunk_bytes, size - offset)});
+  }
+  return chunks;
+}
+
+KeyChunk PlanScatterSegment(int key,
+                            size_t size,
+                            int dtype,
+                            size_t num,
+                            size_t index) {
+  CHECK_GT(num, 0);
+  CHECK_LT(index, num);
+  size_t align = std::max<size_t>(64, GetDataTypeSize(dtype));
+  size_t units = (size + align - 1) / align;
+  // the first `units % num` members take one unit more
+  size_t per = units / num;
+  size_t extra = units % num;
+  size_t begin = (index * per + std::min(index, extra)) * align;
+  size_t end = begin + (per + (index < extra ? 1 : 0)) * align;
+  begin = std::min(begin, size);
+  end = std::min(end, size);
+  return {key, begin, end - begin};
+}
+
+std::vector<KVSlice> PlanMigrateChunks(const KVSlice& kvslice,
+                                       const std::vector<int>& keys,
+                                       const std::vector<CArray>& vals,
+                                       size_t chunk_bytes) {
+  CHECK_EQ(keys.size(), vals.size());
+  if (chunk_bytes > 0) {
+    chunk_bytes = std::max<size_t>(64, (chunk_bytes + 63) / 64 * 64);
+  }
+  std::vector<KVSlice> chunks;
+  auto split = [&chunks, chunk_bytes](int key, uint64_t begin, uint64_t end) {
+    uint64_t step = chunk_bytes ? chunk_bytes : end - begin;
+    for (uint64_t offset = begin; offset < end; offset += step) {
+      chunks.emplace_back(key, offset, std::min<uint64_t>(step, end - offset));
+    }
+  };
+  auto size_of = [&keys, &vals](int key) {
+    auto it = std::find(keys.begin(), keys.end(), key);
+    CHECK(it != keys.end()) << "key " << key << " is not in the keys";
+    return vals[std::distance(keys.begin(), it)].size();
+  };
+  if (!kvslice.is_full()) {
+    CHECK_LE(kvslice.slice + kvslice.slice_len, size_of(kvslice.key_begin));
+    split(kvslice.key_begin, kvslice.slice, kvslice.slice + kvslice.slice_len);
+    return chunks;
+  }
+  for (int key = kvslice.key_begin; key < kvslice.key_end; ++key) {
+    size_t size = size_of(key);
+    if (chunk_bytes == 0 || size <= chunk_bytes) {
+      chunks.emplace_back(key, key + 1);
+    } else {
+      split(key, 0, size);
+    }
+  }
+  return chunks;
+}
+
+std::vector<CArray> SnapshotMigrateValues(const std::vector<CArray>& vals) {
+  std::vector<CArray> snapshot;
+  snapshot.reserve(vals.size());
+  for (const auto& val : vals) {
+    if (val.borrowed_data && !val.owner_) {
+      CArray copy(val.size(), val.dtype);
+      copy.CopyFrom(val);
+      snapshot.push_back(std::move(copy));
+    } else {
+      snapshot.push_back(val);
+    }
+  }
+  return snapshot;
+}
+
+namespace {
+
+/** \brief leads an encoded catch-up, then (zero run, literal run) pairs */
+struct MigrateDeltaHeader {
+  uint64_t len;
+  uint64_t elem_size;
+};
+
+void PutVarint(uint64_t v, std::vector<char>* out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+uint64_t GetVarint(const char** p, const char* end) {
+  uint64_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    CHECK(*p < end && shift < 64) << "malformed migration delta";
+    auto byte = static_cast<uint8_t>(*(*p)++);
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return v;
+    }
+  }
+}
+
+}  // namespace
+
+CArray EncodeMigrateDelta(const CArray& val,
+                          const CArray& base,
+                          size_t offset,
+                          size_t len) {
+  CHECK_EQ(val.size(), base.size());
+  CHECK_LE(offset + len, val.size());
+  size_t elem_size = GetDataTypeSize(val.dtype);
+  if (len % elem_size != 0) {
+    elem_size = 1;
+  }
+  size_t num = len / elem_size;
+  // byte b of element i goes to b * num + i
+  std::vector<char> planes(len);
+  const char* now = val.data() + offset;
+  const char* old = base.data() + offset;
+  for (size_t i = 0; i < num; ++i) {
+    for (size_t b = 0; b < elem_size; ++b) {
+      size_t j = i * elem_size + b;
+      planes[b * num + i] = now[j] ^ old[j];
+    }
+  }
+  MigrateDeltaHeader header{len, elem_size};
+  std::vector<char> out(sizeof(header));
+  std::memcpy(out.data(), &header, sizeof(header));
+  for (size_t i = 0; i < len;) {
+    size_t zeros = i;
+    while (zeros < len && planes[zeros] == 0) {
+      zeros++;
+    }
+    size_t literals = zeros;
+    while (literals < len && planes[literals] != 0) {
+      literals++;
+    }
+    PutVarint(zeros - i, &out);
+    PutVarint(literals - zeros, &out);
+    out.insert(out.end(), planes.begin() + zeros, planes.begin() + literals);
+    i = literals;
+  }
+  CArray delta(out.size(), val.dtype);
+  delta.CopyFrom(out.data(), out.size());
+  return delta;
+}
+
+void ApplyMigrateDelta(const CArray& delta, char* dst, size_t len) {
+  CHECK_GE(delta.size(), sizeof(MigrateDeltaHeader));
+  MigrateDeltaHeader header;
+  std::memcpy(&header, delta.data(), sizeof(header));
+  CHECK_EQ(header.len, len) << "the migration delta is for another slice";
+  CHECK(header.elem_size > 0 && len % header.elem_size == 0)
+      << "malformed migration delta";
+  size_t num = len / header.elem_size;
+  const char* p = delta.data() + sizeof(header);
+  const char* end = delta.data() + delta.size();
+  for (size_t j = 0; j < len;) {
+    uint64_t zeros = GetVarint(&p, end);
+    uint64_t literals = GetVarint(&p, end);
+    CHECK(zeros + literals > 0 && j + zeros + literals <= len &&
+          literals <= static_cast<size_t>(end - p))
+        << "malformed migration delta";
+    j += zeros;
+    for (uint64_t k = 0; k < literals; ++k, ++j) {
+      // plane position j is byte j / num of element j % num
+      dst[(j % num) * header.elem_size + j / num] ^= *p++;
+    }
+  }
+}
+
+}  // namespace constellation
@@ -0,0 +1,131 @@
+#ifndef CONSTELLATION_FUSION_H_
+#define CONSTELLATION_FUSION_H_
+
+#include "constellation_commons.h"
+#include "internal/CArray.h"
+
+#include <limits>
+#include <vector>
+
+namespace constellation {
+
+/**
+ * \brief keys from here on are generated by the trainer (fusion buckets and
+ * key chunks) and never passed in by users
+ */
+constexpr int kVirtualKeyBase = 1 << 30;
+
+/** \brief virtual keys of fusion buckets are kFusionKeyBase + first member */
+constexpr int kFusionKeyBase = kVirtualKeyBase;
+
+/**
+ * \brief virtual keys of key chunks are
+ * kChunkKeyBase + key * kMaxKeyChunks + part
+ */
+constexpr int kChunkKeyBase = kVirtualKeyBase + (1 << 28);
+constexpr int kMaxKeyChunks = 1024;
+/** \brief the largest user key that can be split into chunks */
+constexpr int kMaxChunkedKey =
+    (std::numeric_limits<int>::max() - kChunkKeyBase) / kMaxKeyChunks - 1;
+
+/**
+ * \brief consecutive keys reduced and transported as one buffer
+ */
+struct FusionBucket {
+  /** \brief the key on the wire, the user key itself if not fused */
+  int key;
+  int dtype;
+  /** \brief total size in bytes */
+  size_t size = 0;
+  /** \brief indices into the PushPull arguments */
+  std::vector<size_t> members;
+  /** \brief byte offset of each member in the bucket */
+  std::vector<size_t> offsets;
+
+  bool fused() const {
+    return members.size() > 1;
+  }
+};
+
+/**
+ * \brief pack consecutive keys smaller than `bucket_bytes` and of the same
+ * dtype into buckets of at most `bucket_bytes`. Larger keys get a bucket of
+ * their own. The plan only depends on the keys, their order and sizes, so all
+ * trainers pushing the same keys agree on it.
+ */
+std::vector<FusionBucket> PlanFusionBuckets(const std::vector<int>& keys,
+                                            const std::vector<CArray>& vals,
+                                            size_t bucket_bytes);
+
+/**
+ * \brief a slice of a key reduced and transported on its own
+ */
+struct KeyChunk {
+  /** \brief the key on the wire */
+  int key;
+  /** \brief byte offset of the slice in the key */
+  size_t offset;
+  size_t size;
+};
+
+/**
+ * \brief split a key of `size` bytes into chunks of about `chunk_bytes`,
+ * aligned to the cache line. Keys not larger than `chunk_bytes` stay whole
+ * with their own key, the chunk size grows if the key needs more than
+ * kMaxKeyChunks chunks.
+ */
+std::vector<KeyChunk> PlanKeyChunks(int key,
+                                    size_t size,
+                                    int dtype,
+                                    size_t chunk_bytes);
+
+/**
+ * \brief the slice of a key of `size` bytes reduced by the `index`-th of
+ * `num` members of a scatter group. The slices are about equal, aligned to
+ * the cache line and may be empty for small keys.
+ */
+KeyChunk PlanScatterSegment(int key,
+                            size_t size,
+                            int dtype,
+                            size_t num,
+                            size_t index);
+
+/**
+ * \brief split a slice of the model to migrate into messages of at most
+ * about `chunk_bytes` (aligned to the cache line), so the relays of a path
+ * forward one while the next arrives. A full slice gives each of its keys
+ * whole if small enough, else in partial slices. 0 only splits full slices
+ * by key.
+ */
+std::vector<KVSlice> PlanMigrateChunks(const KVSlice& kvslice,
+                                       const std::vector<int>& keys,
+                                       const std::vector<CArray>& vals,
+                                       size_t chunk_bytes);
+
+/**
+ * \brief the values a migration sends after Migrate returned: a borrowed
+ * buffer may be gone by then and is copied, one with an owner is shared
+ */
+std::vector<CArray> SnapshotMigrateValues(const std::vector<CArray>& vals);
+
+/**
+ * \brief what a catch-up sends for `len` bytes from `offset` of `val` to a
+ * receiver that has the same bytes of `base`: their XOR, the bytes regrouped
+ * by their position in the element and runs of zero bytes left out. The
+ * sign, exponent and high mantissa bytes an update barely changes cost
+ * almost nothing, and it is exact for any dtype.
+ */
+CArray EncodeMigrateDelta(const CArray& val,
+                          const CArray& base,
+                          size_t offset,
+                          size_t len);
+
+/**
+ * \brief apply an EncodeMigrateDelta to the `len` bytes at `dst`, which hold
+ * the base; they then hold the values bit for bit
+ */
+void ApplyMigrateDelta(const CArray& delta, char* dst, size_t len);
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_FUSION_H_
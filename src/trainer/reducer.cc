@@ -0,0 +1,579 @@
+#include "reducer.h"
+#include "internal/CArray.h"
+#include "dmlc/logging.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONSTEL_REDUCER_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define CONSTEL_REDUCER_NEON 1
+#endif
+
+namespace constellation {
+namespace reducer {
+
+namespace {
+
+using SumKernel = void (*)(void* dst, const void* a, const void* b, size_t n);
+
+struct KernelTable {
+  SumKernel f32;
+  SumKernel f64;
+  SumKernel f16;
+  SumKernel bf16;
+  SumKernel i32;
+};
+
+inline uint32_t FloatToBits(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+inline float BitsToFloat(uint32_t bits) {
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+}  // namespace
+
+// IEEE half <-> float with round-to-nearest-even, bit-exact with F16C.
+// Refer to https://github.com/Maratyszcza/FP16
+float HalfToFloat(uint16_t h) {
+  const uint32_t w = static_cast<uint32_t>(h) << 16;
+  const uint32_t sign = w & 0x80000000u;
+  const uint32_t two_w = w + w;
+  const uint32_t exp_offset = 0xE0u << 23;
+  const float normalized = BitsToFloat((two_w >> 4) + exp_offset) * 0x1.0p-112f;
+  const uint32_t magic_mask = 126u << 23;
+  const float denormalized = BitsToFloat((two_w >> 17) | magic_mask) - 0.5f;
+  const uint32_t denormalized_cutoff = 1u << 27;
+  const uint32_t result =
+      sign | (two_w < denormalized_cutoff ? FloatToBits(denormalized) :
+                                            FloatToBits(normalized));
+  return BitsToFloat(result);
+}
+
+uint16_t FloatToHalf(float f) {
+  float base = (std::fabs(f) * 0x1.0p+112f) * 0x1.0p-110f;
+  const uint32_t w = FloatToBits(f);
+  const uint32_t shl1_w = w + w;
+  const uint32_t sign = w & 0x80000000u;
+  uint32_t bias = shl1_w & 0xFF000000u;
+  if (bias < 0x71000000u) {
+    bias = 0x71000000u;
+  }
+  base = BitsToFloat((bias >> 1) + 0x07800000u) + base;
+  const uint32_t bits = FloatToBits(base);
+  const uint32_t exp_bits = (bits >> 13) & 0x00007C00u;
+  const uint32_t mantissa_bits = bits & 0x00000FFFu;
+  const uint32_t nonsign = exp_bits + mantissa_bits;
+  return static_cast<uint16_t>((sign >> 16) |
+                               (shl1_w > 0xFF000000u ? 0x7E00u : nonsign));
+}
+
+namespace {
+
+inline float Bf16ToFloat(uint16_t v) {
+  return BitsToFloat(static_cast<uint32_t>(v) << 16);
+}
+
+inline uint16_t FloatToBf16(float f) {
+  const uint32_t x = FloatToBits(f);
+  if ((x & 0x7fffffffu) > 0x7f800000u) {
+    // keep NaN quiet, rounding could turn it into Inf
+    return static_cast<uint16_t>((x >> 16) | 0x40u);
+  }
+  const uint32_t rounding = 0x7fffu + ((x >> 16) & 1u);
+  return static_cast<uint16_t>((x + rounding) >> 16);
+}
+
+//////// scalar kernels ////////
+
+template <typename T>
+void SumScalar(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<T*>(dst);
+  const auto* x = static_cast<const T*>(a);
+  const auto* y = static_cast<const T*>(b);
+  if constexpr (std::is_integral_v<T>) {
+    // wrap around instead of signed overflow
+    using U = std::make_unsigned_t<T>;
+    for (size_t i = 0; i < n; ++i) {
+      d[i] = static_cast<T>(static_cast<U>(x[i]) + static_cast<U>(y[i]));
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      d[i] = x[i] + y[i];
+    }
+  }
+}
+
+template <float (*ToFloat)(uint16_t), uint16_t (*FromFloat)(float)>
+void SumHalfScalar(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  for (size_t i = 0; i < n; ++i) {
+    d[i] = FromFloat(ToFloat(x[i]) + ToFloat(y[i]));
+  }
+}
+
+constexpr KernelTable kScalarKernels = {
+    SumScalar<float>,
+    SumScalar<double>,
+    SumHalfScalar<HalfToFloat, FloatToHalf>,
+    SumHalfScalar<Bf16ToFloat, FloatToBf16>,
+    SumScalar<int32_t>,
+};
+
+#ifdef CONSTEL_REDUCER_X86
+//////// AVX2 kernels ////////
+
+__attribute__((target("avx2"))) void SumF32Avx2(void* dst,
+                                                 const void* a,
+                                                 const void* b,
+                                                 size_t n) {
+  auto* d = static_cast<float*>(dst);
+  const auto* x = static_cast<const float*>(a);
+  const auto* y = static_cast<const float*>(b);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i));
+    __m256 s1 =
+        _mm256_add_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8));
+    _mm256_storeu_ps(d + i, s0);
+    _mm256_storeu_ps(d + i + 8, s1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(d + i,
+                     _mm256_add_ps(_mm256_loadu_ps(x + i),
+                                   _mm256_loadu_ps(y + i)));
+  }
+  SumScalar<float>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2"))) void SumF64Avx2(void* dst,
+                                                 const void* a,
+                                                 const void* b,
+                                                 size_t n) {
+  auto* d = static_cast<double*>(dst);
+  const auto* x = static_cast<const double*>(a);
+  const auto* y = static_cast<const double*>(b);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(d + i,
+                     _mm256_add_pd(_mm256_loadu_pd(x + i),
+                                   _mm256_loadu_pd(y + i)));
+  }
+  SumScalar<double>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2"))) void SumI32Avx2(void* dst,
+                                                 const void* a,
+                                                 const void* b,
+                                                 size_t n) {
+  auto* d = static_cast<int32_t*>(dst);
+  const auto* x = static_cast<const int32_t*>(a);
+  const auto* y = static_cast<const int32_t*>(b);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+    __m256i vy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i),
+                        _mm256_add_epi32(vx, vy));
+  }
+  SumScalar<int32_t>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2,f16c"))) void SumF16Avx2(void* dst,
+                                                      const void* a,
+                                                      const void* b,
+                                                      size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    __m256 vy = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i)));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(d + i),
+        _mm256_cvtps_ph(_mm256_add_ps(vx, vy), _MM_FROUND_TO_NEAREST_INT));
+  }
+  SumHalfScalar<HalfToFloat, FloatToHalf>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline __m256 LoadBf16Avx2(
+    const uint16_t* p) {
+  __m256i v = _mm256_cvtepu16_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(v, 16));
+}
+
+__attribute__((target("avx2"))) void SumBf16Avx2(void* dst,
+                                                  const void* a,
+                                                  const void* b,
+                                                  size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i bias = _mm256_set1_epi32(0x7fff);
+  const __m256i quiet = _mm256_set1_epi32(0x40);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 sum = _mm256_add_ps(LoadBf16Avx2(x + i), LoadBf16Avx2(y + i));
+    __m256i bits = _mm256_castps_si256(sum);
+    __m256i hi = _mm256_srli_epi32(bits, 16);
+    __m256i rounded = _mm256_srli_epi32(
+        _mm256_add_epi32(bits, _mm256_add_epi32(bias, _mm256_and_si256(hi, one))),
+        16);
+    __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(sum, sum, _CMP_UNORD_Q));
+    rounded = _mm256_blendv_epi8(rounded, _mm256_or_si256(hi, quiet), nan);
+    // 8 x u32 -> 8 x u16, packus works per 128-bit lane
+    __m256i packed = _mm256_packus_epi32(rounded, rounded);
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i),
+                     _mm256_castsi256_si128(packed));
+  }
+  SumHalfScalar<Bf16ToFloat, FloatToBf16>(d + i, x + i, y + i, n - i);
+}
+
+//////// AVX-512 kernels ////////
+
+__attribute__((target("avx512f"))) void SumF32Avx512(void* dst,
+                                                      const void* a,
+                                                      const void* b,
+                                                      size_t n) {
+  auto* d = static_cast<float*>(dst);
+  const auto* x = static_cast<const float*>(a);
+  const auto* y = static_cast<const float*>(b);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m512 s0 = _mm512_add_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i));
+    __m512 s1 = _mm512_add_ps(_mm512_loadu_ps(x + i + 16),
+                              _mm512_loadu_ps(y + i + 16));
+    _mm512_storeu_ps(d + i, s0);
+    _mm512_storeu_ps(d + i + 16, s1);
+  }
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(d + i,
+                     _mm512_add_ps(_mm512_loadu_ps(x + i),
+                                   _mm512_loadu_ps(y + i)));
+  }
+  SumScalar<float>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void SumF64Avx512(void* dst,
+                                                      const void* a,
+                                                      const void* b,
+                                                      size_t n) {
+  auto* d = static_cast<double*>(dst);
+  const auto* x = static_cast<const double*>(a);
+  const auto* y = static_cast<const double*>(b);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm512_storeu_pd(d + i,
+                     _mm512_add_pd(_mm512_loadu_pd(x + i),
+                                   _mm512_loadu_pd(y + i)));
+  }
+  SumScalar<double>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void SumI32Avx512(void* dst,
+                                                      const void* a,
+                                                      const void* b,
+                                                      size_t n) {
+  auto* d = static_cast<int32_t*>(dst);
+  const auto* x = static_cast<const int32_t*>(a);
+  const auto* y = static_cast<const int32_t*>(b);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_si512(d + i,
+                        _mm512_add_epi32(_mm512_loadu_si512(x + i),
+                                         _mm512_loadu_si512(y + i)));
+  }
+  SumScalar<int32_t>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void SumF16Avx512(void* dst,
+                                                      const void* a,
+                                                      const void* b,
+                                                      size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 vx = _mm512_cvtph_ps(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+    __m512 vy = _mm512_cvtph_ps(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i)));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(d + i),
+        _mm512_cvtps_ph(_mm512_add_ps(vx, vy), _MM_FROUND_TO_NEAREST_INT));
+  }
+  SumHalfScalar<HalfToFloat, FloatToHalf>(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx512f"))) inline __m512 LoadBf16Avx512(
+    const uint16_t* p) {
+  __m512i v = _mm512_cvtepu16_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(v, 16));
+}
+
+__attribute__((target("avx512f"))) void SumBf16Avx512(void* dst,
+                                                       const void* a,
+                                                       const void* b,
+                                                       size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i bias = _mm512_set1_epi32(0x7fff);
+  const __m512i quiet = _mm512_set1_epi32(0x40);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 sum = _mm512_add_ps(LoadBf16Avx512(x + i), LoadBf16Avx512(y + i));
+    __m512i bits = _mm512_castps_si512(sum);
+    __m512i hi = _mm512_srli_epi32(bits, 16);
+    __m512i rounded = _mm512_srli_epi32(
+        _mm512_add_epi32(bits, _mm512_add_epi32(bias, _mm512_and_si512(hi, one))),
+        16);
+    __mmask16 nan = _mm512_cmp_ps_mask(sum, sum, _CMP_UNORD_Q);
+    rounded = _mm512_mask_blend_epi32(nan, rounded, _mm512_or_si512(hi, quiet));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i),
+                        _mm512_cvtepi32_epi16(rounded));
+  }
+  SumHalfScalar<Bf16ToFloat, FloatToBf16>(d + i, x + i, y + i, n - i);
+}
+
+constexpr KernelTable kAvx2Kernels = {
+    SumF32Avx2, SumF64Avx2, SumF16Avx2, SumBf16Avx2, SumI32Avx2};
+
+constexpr KernelTable kAvx512Kernels = {
+    SumF32Avx512, SumF64Avx512, SumF16Avx512, SumBf16Avx512, SumI32Avx512};
+#endif  // CONSTEL_REDUCER_X86
+
+#ifdef CONSTEL_REDUCER_NEON
+//////// NEON kernels ////////
+
+void SumF32Neon(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<float*>(dst);
+  const auto* x = static_cast<const float*>(a);
+  const auto* y = static_cast<const float*>(b);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t s0 = vaddq_f32(vld1q_f32(x + i), vld1q_f32(y + i));
+    float32x4_t s1 = vaddq_f32(vld1q_f32(x + i + 4), vld1q_f32(y + i + 4));
+    vst1q_f32(d + i, s0);
+    vst1q_f32(d + i + 4, s1);
+  }
+  SumScalar<float>(d + i, x + i, y + i, n - i);
+}
+
+void SumF64Neon(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<double*>(dst);
+  const auto* x = static_cast<const double*>(a);
+  const auto* y = static_cast<const double*>(b);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    vst1q_f64(d + i, vaddq_f64(vld1q_f64(x + i), vld1q_f64(y + i)));
+  }
+  SumScalar<double>(d + i, x + i, y + i, n - i);
+}
+
+void SumI32Neon(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<int32_t*>(dst);
+  const auto* x = static_cast<const int32_t*>(a);
+  const auto* y = static_cast<const int32_t*>(b);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32(d + i, vaddq_s32(vld1q_s32(x + i), vld1q_s32(y + i)));
+  }
+  SumScalar<int32_t>(d + i, x + i, y + i, n - i);
+}
+
+void SumF16Neon(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t vx = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(x + i)));
+    float32x4_t vy = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(y + i)));
+    vst1_u16(d + i, vreinterpret_u16_f16(vcvt_f16_f32(vaddq_f32(vx, vy))));
+  }
+  SumHalfScalar<HalfToFloat, FloatToHalf>(d + i, x + i, y + i, n - i);
+}
+
+void SumBf16Neon(void* dst, const void* a, const void* b, size_t n) {
+  auto* d = static_cast<uint16_t*>(dst);
+  const auto* x = static_cast<const uint16_t*>(a);
+  const auto* y = static_cast<const uint16_t*>(b);
+  const uint32x4_t one = vdupq_n_u32(1);
+  const uint32x4_t bias = vdupq_n_u32(0x7fff);
+  const uint32x4_t quiet = vdupq_n_u32(0x40);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t vx = vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(x + i), 16));
+    float32x4_t vy = vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(y + i), 16));
+    float32x4_t sum = vaddq_f32(vx, vy);
+    uint32x4_t bits = vreinterpretq_u32_f32(sum);
+    uint32x4_t hi = vshrq_n_u32(bits, 16);
+    uint32x4_t rounded =
+        vaddq_u32(bits, vaddq_u32(bias, vandq_u32(hi, one)));
+    rounded = vshrq_n_u32(rounded, 16);
+    uint32x4_t not_nan = vceqq_f32(sum, sum);
+    rounded = vbslq_u32(not_nan, rounded, vorrq_u32(hi, quiet));
+    vst1_u16(d + i, vmovn_u32(rounded));
+  }
+  SumHalfScalar<Bf16ToFloat, FloatToBf16>(d + i, x + i, y + i, n - i);
+}
+
+constexpr KernelTable kNeonKernels = {
+    SumF32Neon, SumF64Neon, SumF16Neon, SumBf16Neon, SumI32Neon};
+#endif  // CONSTEL_REDUCER_NEON
+
+bool IsSupported(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return true;
+#ifdef CONSTEL_REDUCER_X86
+    case SimdLevel::kAVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    case SimdLevel::kAVX512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef CONSTEL_REDUCER_NEON
+    case SimdLevel::kNeon:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+SimdLevel DetectSimdLevel() {
+  for (auto level : {SimdLevel::kAVX512, SimdLevel::kAVX2, SimdLevel::kNeon}) {
+    if (IsSupported(level)) {
+      return level;
+    }
+  }
+  return SimdLevel::kScalar;
+}
+
+std::atomic<SimdLevel>& CurrentLevel() {
+  static std::atomic<SimdLevel> level{DetectSimdLevel()};
+  return level;
+}
+
+const KernelTable& GetKernels(SimdLevel level) {
+  switch (level) {
+#ifdef CONSTEL_REDUCER_X86
+    case SimdLevel::kAVX2:
+      return kAvx2Kernels;
+    case SimdLevel::kAVX512:
+      return kAvx512Kernels;
+#endif
+#ifdef CONSTEL_REDUCER_NEON
+    case SimdLevel::kNeon:
+      return kNeonKernels;
+#endif
+    default:
+      return kScalarKernels;
+  }
+}
+
+}  // namespace
+
+void Sum(void* dst, const void* src, size_t len, int dtype) {
+  Sum(dst, dst, src, len, dtype);
+}
+
+void Sum(void* dst,
+         const void* src1,
+         const void* src2,
+         size_t len,
+         int dtype) {
+  size_t type_size = GetDataTypeSize(dtype);
+  CHECK_EQ(len % type_size, 0)
+      << "len " << len << " is not a multiple of dtype " << dtype;
+  size_t n = len / type_size;
+  if (n == 0) {
+    return;
+  }
+  const auto& kernels = GetKernels(CurrentLevel().load(std::memory_order_relaxed));
+  switch (static_cast<ConstelDataType>(dtype)) {
+    case ConstelDataType::CONSTEL_FLOAT32:
+      kernels.f32(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_FLOAT64:
+      kernels.f64(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_FLOAT16:
+      kernels.f16(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_BFLOAT16:
+      kernels.bf16(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_INT32:
+      kernels.i32(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_UINT8:
+      SumScalar<uint8_t>(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_INT8:
+      SumScalar<int8_t>(dst, src1, src2, n);
+      break;
+    case ConstelDataType::CONSTEL_INT64:
+      SumScalar<int64_t>(dst, src1, src2, n);
+      break;
+    default:
+      LOG(FATAL) << "unsupported dtype " << dtype;
+  }
+}
+
+SimdLevel GetSimdLevel() {
+  return CurrentLevel().load();
+}
+
+bool SetSimdLevel(SimdLevel level) {
+  if (!IsSupported(level)) {
+    return false;
+  }
+  CurrentLevel().store(level);
+  return true;
+}
+
+const char* SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return "scalar";
+    case SimdLevel::kNeon:
+      return "neon";
+    case SimdLevel::kAVX2:
+      return "avx2";
+    case SimdLevel::kAVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+}  // namespace reducer
+}  // namespace constellation
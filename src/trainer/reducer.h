@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace constellation {
+namespace reducer {
+
+/** @brief instruction set used by the reduction kernels */
+enum class SimdLevel {
+  kScalar,
+  kNeon,
+  kAVX2,
+  kAVX512,
+};
+
+/**
+ * @brief dst[i] += src[i], element-wise for `len` bytes of `dtype` elements.
+ * The kernel is selected by `dtype` (see `ConstelDataType`) and the best
+ * instruction set supported by the running CPU.
+ */
+void Sum(void* dst, const void* src, size_t len, int dtype);
+
+/**
+ * @brief dst[i] = src1[i] + src2[i]. `dst` may alias `src1` or `src2`.
+ */
+void Sum(void* dst,
+         const void* src1,
+         const void* src2,
+         size_t len,
+         int dtype);
+
+/** @brief IEEE half to float */
+float HalfToFloat(uint16_t h);
+
+/** @brief float to IEEE half, rounding to nearest even */
+uint16_t FloatToHalf(float f);
+
+/** @brief the instruction set currently used by `Sum` */
+SimdLevel GetSimdLevel();
+
+/**
+ * @brief force the kernels to `level`, mainly for tests and benchmarks.
+ * @return false if the running CPU does not support `level`
+ */
+bool SetSimdLevel(SimdLevel level);
+
+const char* SimdLevelName(SimdLevel level);
+
+}  // namespace reducer
+}  // namespace constellation
@@ -0,0 +1,148 @@
+#include "row_sparse.h"
+#include "reducer.h"
+
+#include "dmlc/logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace constellation {
+
+namespace {
+
+RowSparseHeader ReadHeader(const CArray& packed) {
+  CHECK_GE(packed.size(), sizeof(RowSparseHeader));
+  RowSparseHeader header;
+  std::memcpy(&header, packed.data(), sizeof(header));
+  CHECK_EQ(packed.size(),
+           sizeof(header) +
+               header.num_rows * (sizeof(uint64_t) + header.row_bytes))
+      << "malformed row-sparse value";
+  return header;
+}
+
+const uint64_t* RowIds(const CArray& packed) {
+  return reinterpret_cast<const uint64_t*>(packed.data() +
+                                           sizeof(RowSparseHeader));
+}
+
+const char* Rows(const CArray& packed, const RowSparseHeader& header) {
+  return packed.data() + sizeof(header) + header.num_rows * sizeof(uint64_t);
+}
+
+CArray AllocPacked(uint64_t num_rows, uint64_t row_bytes, int dtype) {
+  CArray packed(
+      sizeof(RowSparseHeader) + num_rows * (sizeof(uint64_t) + row_bytes),
+      dtype);
+  RowSparseHeader header{num_rows, num_rows ? row_bytes : 0};
+  std::memcpy(packed.data(), &header, sizeof(header));
+  return packed;
+}
+
+}  // namespace
+
+CArray PackRowSparse(const std::vector<uint64_t>& row_ids,
+                     const CArray& rows) {
+  size_t n = row_ids.size();
+  size_t row_bytes = n ? rows.size() / n : 0;
+  CHECK_EQ(row_bytes * n, rows.size()) << "rows do not match the row ids";
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&row_ids](size_t a, size_t b) {
+    return row_ids[a] < row_ids[b];
+  });
+  size_t num_unique = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (i == 0 || row_ids[order[i]] != row_ids[order[i - 1]]) {
+      num_unique++;
+    }
+  }
+  CArray packed = AllocPacked(num_unique, row_bytes, rows.dtype);
+  auto* ids = reinterpret_cast<uint64_t*>(packed.data() +
+                                          sizeof(RowSparseHeader));
+  char* out = reinterpret_cast<char*>(ids + num_unique);
+  size_t j = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const char* row = rows.data() + order[i] * row_bytes;
+    if (i > 0 && row_ids[order[i]] == row_ids[order[i - 1]]) {
+      reducer::Sum(out + (j - 1) * row_bytes, row, row_bytes, rows.dtype);
+      continue;
+    }
+    ids[j] = row_ids[order[i]];
+    std::memcpy(out + j * row_bytes, row, row_bytes);
+    j++;
+  }
+  return packed;
+}
+
+void UnpackRowSparse(const CArray& packed,
+                     std::vector<uint64_t>* row_ids,
+                     CArray* rows) {
+  auto header = ReadHeader(packed);
+  const uint64_t* ids = RowIds(packed);
+  row_ids->assign(ids, ids + header.num_rows);
+  // keep the packed buffer alive instead of copying the rows out
+  std::shared_ptr<void> owner = packed.borrowed_data
+                                    ? packed.owner_
+                                    : std::shared_ptr<void>(packed.sptr_);
+  *rows = CArray(std::move(owner),
+                 Rows(packed, header),
+                 header.num_rows * header.row_bytes,
+                 packed.dtype);
+}
+
+CArray MergeRowSparse(const CArray& a, const CArray& b) {
+  auto ha = ReadHeader(a);
+  auto hb = ReadHeader(b);
+  if (ha.num_rows == 0) {
+    return b;
+  }
+  if (hb.num_rows == 0) {
+    return a;
+  }
+  CHECK_EQ(ha.row_bytes, hb.row_bytes) << "rows of different sizes";
+  CHECK_EQ(a.dtype, b.dtype);
+  size_t row_bytes = ha.row_bytes;
+  const uint64_t* ids_a = RowIds(a);
+  const uint64_t* ids_b = RowIds(b);
+  const char* rows_a = Rows(a, ha);
+  const char* rows_b = Rows(b, hb);
+  // count the union first, so the result is allocated once
+  size_t num_rows = 0;
+  for (size_t i = 0, j = 0; i < ha.num_rows || j < hb.num_rows; ++num_rows) {
+    if (j == hb.num_rows || (i < ha.num_rows && ids_a[i] < ids_b[j])) {
+      i++;
+    } else if (i == ha.num_rows || ids_b[j] < ids_a[i]) {
+      j++;
+    } else {
+      i++;
+      j++;
+    }
+  }
+  CArray merged = AllocPacked(num_rows, row_bytes, a.dtype);
+  auto* ids = reinterpret_cast<uint64_t*>(merged.data() +
+                                          sizeof(RowSparseHeader));
+  char* out = reinterpret_cast<char*>(ids + num_rows);
+  size_t i = 0, j = 0;
+  for (size_t k = 0; k < num_rows; ++k) {
+    char* row = out + k * row_bytes;
+    if (j == hb.num_rows || (i < ha.num_rows && ids_a[i] < ids_b[j])) {
+      ids[k] = ids_a[i];
+      std::memcpy(row, rows_a + i++ * row_bytes, row_bytes);
+    } else if (i == ha.num_rows || ids_b[j] < ids_a[i]) {
+      ids[k] = ids_b[j];
+      std::memcpy(row, rows_b + j++ * row_bytes, row_bytes);
+    } else {
+      ids[k] = ids_a[i];
+      reducer::Sum(row,
+                   rows_a + i++ * row_bytes,
+                   rows_b + j++ * row_bytes,
+                   row_bytes,
+                   a.dtype);
+    }
+  }
+  return merged;
+}
+
+}  // namespace constellation
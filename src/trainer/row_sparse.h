@@ -0,0 +1,44 @@
+#ifndef CONSTELLATION_ROW_SPARSE_H_
+#define CONSTELLATION_ROW_SPARSE_H_
+
+#include "internal/CArray.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace constellation {
+
+/**
+ * \brief a row-sparse value on the wire: this header, `num_rows` row ids in
+ * increasing order, then the rows in the same order. Only the rows a trainer
+ * touched (e.g. of an embedding table) are sent.
+ */
+struct RowSparseHeader {
+  uint64_t num_rows;
+  /** \brief 0 if there are no rows */
+  uint64_t row_bytes;
+};
+
+/**
+ * \brief pack `rows` (rows.size() / row_ids.size() bytes each) by row id.
+ * The ids do not need to be sorted, rows of the same id are summed.
+ */
+CArray PackRowSparse(const std::vector<uint64_t>& row_ids, const CArray& rows);
+
+/**
+ * \brief the row ids and rows of a packed value. `rows` shares the memory of
+ * `packed`.
+ */
+void UnpackRowSparse(const CArray& packed,
+                     std::vector<uint64_t>* row_ids,
+                     CArray* rows);
+
+/**
+ * \brief sum of two packed values of the same dtype: the union of their rows,
+ * rows of the same id summed (sort-merge)
+ */
+CArray MergeRowSparse(const CArray& a, const CArray& b);
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_ROW_SPARSE_H_
@@ -0,0 +1,162 @@
+#ifndef CONSTELLATION_KEY_TABLE_H_
+#define CONSTELLATION_KEY_TABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace constellation {
+
+/**
+ * \brief per-key state addressed by the key itself, without a global lock.
+ *
+ * A three level radix table over the 32 bit key (12/10/10 bits), like a page
+ * table: a lookup is three atomic loads, and blocks and entries are created
+ * on first use with a CAS. Dense keys share leaf blocks, the virtual keys of
+ * fusion buckets and key chunks only add a few blocks. Entries are allocated
+ * one by one and never moved or freed before the table; declare `T` with
+ * alignas(64) so neighbouring keys updated by different threads do not share
+ * a cache line.
+ *
+ * Synchronizing the entry itself is up to `T`.
+ */
+template <typename T>
+class KeyTable {
+ public:
+  KeyTable() = default;
+  KeyTable(const KeyTable&) = delete;
+  KeyTable& operator=(const KeyTable&) = delete;
+
+  ~KeyTable() {
+    for (auto& mid : root_) {
+      Mid* m = mid.load(std::memory_order_relaxed);
+      if (m == nullptr)
+        continue;
+      for (auto& leaf : m->leaves) {
+        Leaf* l = leaf.load(std::memory_order_relaxed);
+        if (l == nullptr)
+          continue;
+        for (auto& entry : l->entries) {
+          delete entry.load(std::memory_order_relaxed);
+        }
+        delete l;
+      }
+      delete m;
+    }
+  }
+
+  /** \brief the entry of `key`, default constructed on first use */
+  T* Get(int key) {
+    return GetOrCreate(key, []() { return new T(); });
+  }
+
+  /**
+   * \brief the entry of `key`, built by `make()` (returning a new T*) on first
+   * use. When threads race only one built entry is kept, the others are
+   * deleted, so `make` must not have side effects.
+   */
+  template <typename Make>
+  T* GetOrCreate(int key, Make make) {
+    auto& slot = Slot(key);
+    T* entry = slot.load(std::memory_order_acquire);
+    if (entry != nullptr) {
+      return entry;
+    }
+    T* created = make();
+    if (slot.compare_exchange_strong(entry,
+                                     created,
+                                     std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+      return created;
+    }
+    delete created;
+    return entry;
+  }
+
+  /** \brief the entry of `key` or nullptr, never creates */
+  T* Find(int key) const {
+    uint32_t k = static_cast<uint32_t>(key);
+    Mid* mid = root_[k >> 20].load(std::memory_order_acquire);
+    if (mid == nullptr)
+      return nullptr;
+    Leaf* leaf = mid->leaves[(k >> 10) & kMask].load(std::memory_order_acquire);
+    if (leaf == nullptr)
+      return nullptr;
+    return leaf->entries[k & kMask].load(std::memory_order_acquire);
+  }
+
+  /** \brief create the entries of keys [0, num_keys) up front */
+  void Reserve(int num_keys) {
+    for (int key = 0; key < num_keys; ++key) {
+      Get(key);
+    }
+  }
+
+  /**
+   * \brief call `fn(key, T*)` on every entry, in key order. Entries created
+   * concurrently may or may not be visited.
+   */
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (uint32_t i = 0; i < kRootSize; ++i) {
+      Mid* mid = root_[i].load(std::memory_order_acquire);
+      if (mid == nullptr)
+        continue;
+      for (uint32_t j = 0; j <= kMask; ++j) {
+        Leaf* leaf = mid->leaves[j].load(std::memory_order_acquire);
+        if (leaf == nullptr)
+          continue;
+        for (uint32_t n = 0; n <= kMask; ++n) {
+          T* entry = leaf->entries[n].load(std::memory_order_acquire);
+          if (entry != nullptr) {
+            fn(static_cast<int>((i << 20) | (j << 10) | n), entry);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kMask = (1 << 10) - 1;
+  static constexpr uint32_t kRootSize = 1 << 12;
+
+  struct Leaf {
+    std::atomic<T*> entries[kMask + 1] = {};
+  };
+
+  struct Mid {
+    std::atomic<Leaf*> leaves[kMask + 1] = {};
+  };
+
+  template <typename Node>
+  static Node* GetOrCreateNode(std::atomic<Node*>& slot) {
+    Node* node = slot.load(std::memory_order_acquire);
+    if (node != nullptr) {
+      return node;
+    }
+    Node* created = new Node();
+    if (slot.compare_exchange_strong(node,
+                                     created,
+                                     std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+      return created;
+    }
+    delete created;
+    return node;
+  }
+
+  std::atomic<T*>& Slot(int key) {
+    uint32_t k = static_cast<uint32_t>(key);
+    Mid* mid = GetOrCreateNode(root_[k >> 20]);
+    Leaf* leaf = GetOrCreateNode(mid->leaves[(k >> 10) & kMask]);
+    return leaf->entries[k & kMask];
+  }
+
+  std::atomic<Mid*> root_[kRootSize] = {};
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_KEY_TABLE_H_
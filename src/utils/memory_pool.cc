@@ -0,0 +1,189 @@
+#include "internal/memory_pool.h"
+#include "internal/utils.h"
+
+#include <cstdlib>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace constellation {
+
+/**
+ * @brief per-thread free lists of small buffers, flushed to the shared list
+ * when the thread exits
+ */
+// set once the cache of this thread is destroyed, buffers freed later (by
+// other thread_local destructors) go to the shared list
+static thread_local bool thread_cache_gone = false;
+
+struct ThreadCache {
+  std::vector<void*> bins[MemoryPool::kNumClasses];
+
+  ~ThreadCache() {
+    thread_cache_gone = true;
+    auto* pool = MemoryPool::Get();
+    for (int i = 0; i < MemoryPool::kNumClasses; ++i) {
+      for (void* ptr : bins[i]) {
+        pool->PushShared(i, ptr);
+      }
+    }
+  }
+};
+
+static ThreadCache* GetThreadCache() {
+  if (thread_cache_gone) {
+    return nullptr;
+  }
+  static thread_local ThreadCache cache;
+  return &cache;
+}
+
+MemoryPool* MemoryPool::Get() {
+  // never destroyed, thread caches may flush into it at exit
+  static MemoryPool* pool = new MemoryPool();
+  return pool;
+}
+
+MemoryPool::MemoryPool()
+    : enabled_(get_env("CONSTEL_MEMORY_POOL", 1) != 0),
+      huge_page_(get_env("CONSTEL_POOL_HUGEPAGE", 0) != 0),
+      max_cached_bytes_(
+          static_cast<uint64_t>(get_env("CONSTEL_POOL_MAX_CACHED_MB", 512))
+          << 20) {}
+
+int MemoryPool::ClassIndex(size_t size, size_t* class_size) {
+  if (size <= kAlignment) {
+    *class_size = kAlignment;
+    return 0;
+  }
+  // 2^k < size <= 2^(k+1), split into four classes of 2^(k-2)
+  int k = 63 - __builtin_clzll(size - 1);
+  size_t step = size_t(1) << (k - 2);
+  size_t j = (size - 1 - (size_t(1) << k)) / step + 1;
+  *class_size = (size_t(1) << k) + j * step;
+  return (k - 6) * 4 + static_cast<int>(j);
+}
+
+size_t MemoryPool::ClassSizeOf(int idx) {
+  if (idx == 0) {
+    return kAlignment;
+  }
+  int k = 6 + (idx - 1) / 4;
+  size_t j = (idx - 1) % 4 + 1;
+  return (size_t(1) << k) + j * (size_t(1) << (k - 2));
+}
+
+size_t MemoryPool::ClassSize(size_t size) {
+  size_t class_size;
+  ClassIndex(size, &class_size);
+  return class_size;
+}
+
+void* MemoryPool::SystemAlloc(size_t class_size) {
+  size_t align = class_size >= kHugePageSize ? kHugePageSize : kAlignment;
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, align, class_size) != 0) {
+    throw std::bad_alloc();
+  }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (huge_page_ && class_size >= kHugePageSize) {
+    madvise(ptr, class_size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void MemoryPool::SystemFree(void* ptr) {
+  free(ptr);
+}
+
+void* MemoryPool::PopShared(int idx) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto& list = free_[idx];
+  if (list.empty()) {
+    return nullptr;
+  }
+  void* ptr = list.back();
+  list.pop_back();
+  return ptr;
+}
+
+void MemoryPool::PushShared(int idx, void* ptr) {
+  std::lock_guard<std::mutex> lock(mu_);
+  free_[idx].push_back(ptr);
+}
+
+void* MemoryPool::Alloc(size_t size) {
+  if (size == 0) {
+    return nullptr;
+  }
+  size_t class_size;
+  int idx = ClassIndex(size, &class_size);
+  bytes_in_use_ += class_size;
+  if (enabled_) {
+    void* ptr = nullptr;
+    auto* cache = class_size <= kMaxThreadCacheSize ? GetThreadCache()
+                                                    : nullptr;
+    if (cache && !cache->bins[idx].empty()) {
+      ptr = cache->bins[idx].back();
+      cache->bins[idx].pop_back();
+    }
+    if (ptr == nullptr) {
+      ptr = PopShared(idx);
+    }
+    if (ptr != nullptr) {
+      hits_++;
+      bytes_cached_ -= class_size;
+      return ptr;
+    }
+  }
+  misses_++;
+  return SystemAlloc(class_size);
+}
+
+void MemoryPool::Free(void* ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  size_t class_size;
+  int idx = ClassIndex(size, &class_size);
+  bytes_in_use_ -= class_size;
+  uint64_t max_cached = max_cached_bytes_.load();
+  if (!enabled_ ||
+      (max_cached > 0 && bytes_cached_.load() + class_size > max_cached)) {
+    SystemFree(ptr);
+    return;
+  }
+  bytes_cached_ += class_size;
+  auto* cache =
+      class_size <= kMaxThreadCacheSize ? GetThreadCache() : nullptr;
+  if (cache && cache->bins[idx].size() < kThreadCacheBlocks) {
+    cache->bins[idx].push_back(ptr);
+    return;
+  }
+  PushShared(idx, ptr);
+}
+
+MemoryPool::Stats MemoryPool::GetStats() const {
+  Stats stats;
+  stats.hits = hits_.load();
+  stats.misses = misses_.load();
+  stats.bytes_cached = bytes_cached_.load();
+  stats.bytes_in_use = bytes_in_use_.load();
+  return stats;
+}
+
+void MemoryPool::Trim(uint64_t keep_bytes) {
+  std::lock_guard<std::mutex> lock(mu_);
+  for (int i = kNumClasses - 1; i >= 0; --i) {
+    auto& list = free_[i];
+    while (!list.empty() && bytes_cached_.load() > keep_bytes) {
+      SystemFree(list.back());
+      list.pop_back();
+      bytes_cached_ -= ClassSizeOf(i);
+    }
+  }
+}
+
+}  // namespace constellation
@@ -0,0 +1,174 @@
+#ifndef CONSTELLATION_MPSC_QUEUE_H_
+#define CONSTELLATION_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace constellation {
+
+/**
+ * \brief bounded lock-free multi-producer single-consumer ring queue.
+ *
+ * Every cell carries a sequence number (Vyukov's bounded queue): producers
+ * claim a slot with one CAS on the enqueue position and publish it by bumping
+ * the sequence, the consumer reads the sequence of its next cell only. Values
+ * are moved in and out, nothing is copied.
+ *
+ * Only one thread may pop at a time. The consumer role may pass between
+ * threads as long as the handoff synchronizes (e.g. through an atomic flag).
+ * A full queue makes `Push` spin and then yield; an empty queue makes
+ * `WaitAndPop` spin and then park on a condition variable.
+ */
+template <typename T>
+class MPSCQueue {
+ public:
+  explicit MPSCQueue(size_t capacity = 1024) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  ~MPSCQueue() {
+    T value;
+    while (TryPop(&value)) {
+    }
+  }
+
+  /** \brief enqueue `value`, false if the queue is full */
+  bool TryPush(T&& value) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(value));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    // pairs with the fence in WaitAndPop, either the consumer sees the value
+    // or we see it parking
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_parked_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(park_mu_);
+      park_cv_.notify_one();
+    }
+    return true;
+  }
+
+  /** \brief enqueue `value`, waiting for a free slot if the queue is full */
+  void Push(T&& value) {
+    for (int spin = 0; !TryPush(std::move(value)); ++spin) {
+      if (spin < kSpinCount) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void Push(const T& value) {
+    T copy(value);
+    Push(std::move(copy));
+  }
+
+  /** \brief dequeue into `value`, false if the queue is empty. Consumer only */
+  bool TryPop(T* value) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell = &cells_[pos & mask_];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+      return false;
+    }
+    T* stored = reinterpret_cast<T*>(&cell->storage);
+    *value = std::move(*stored);
+    stored->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /** \brief dequeue into `value`, spinning and then parking while empty */
+  void WaitAndPop(T* value) {
+    for (int spin = 0; spin < kSpinCount; ++spin) {
+      if (TryPop(value))
+        return;
+      CpuRelax();
+    }
+    std::unique_lock<std::mutex> lock(park_mu_);
+    while (true) {
+      consumer_parked_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (TryPop(value))
+        break;
+      park_cv_.wait(lock);
+    }
+    consumer_parked_.store(false, std::memory_order_relaxed);
+  }
+
+  /** \brief whether the next pop would fail. Consumer only */
+  bool Empty() const {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+    return static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  static constexpr int kSpinCount = 128;
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  // producers and the consumer write different positions, keep them on
+  // separate cache lines
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  alignas(64) std::atomic<bool> consumer_parked_{false};
+  std::mutex park_mu_;
+  std::condition_variable park_cv_;
+};
+
+}  // namespace constellation
+
+#endif  // CONSTELLATION_MPSC_QUEUE_H_
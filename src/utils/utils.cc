@@ -1,5 +1,6 @@
 #include "internal/utils.h"
 #include <cstring>
+#include <cstdlib>
 #include <chrono>
 
 namespace constellation {
@@ -24,4 +25,19 @@ int64_t get_time_point(const char* unit) {
   throw std::invalid_argument("unit must be 'ms' or 'us'");
 }
 
+int64_t get_env(const char* name, int64_t default_val) {
+  const char* val = std::getenv(name);
+  if (val == nullptr || *val == '\0') {
+    return default_val;
+  }
+  char* end = nullptr;
+  int64_t ret = std::strtoll(val, &end, 10);
+  return *end == '\0' ? ret : default_val;
+}
+
+std::string get_env_str(const char* name, const std::string& default_val) {
+  const char* val = std::getenv(name);
+  return val == nullptr ? default_val : std::string(val);
+}
+
 }  // namespace constellation
\ No newline at end of file
@@ -91,3 +91,19 @@ TEST_F(CArrayTest, BorrowedTest) {
   EXPECT_EQ(memcmp(array.data(), data, 3), 0);
   EXPECT_EQ(s1, "321");
 }
+
+TEST_F(CArrayTest, SharedOwnerTest) {
+  std::shared_ptr<char> buf(new char[4], std::default_delete<char[]>());
+  std::weak_ptr<char> weak = buf;
+  memcpy(buf.get(), "abc", 4);
+  CArray array(buf, buf.get(), 4);
+  buf.reset();
+  // the CArray keeps the buffer alive without copying it
+  EXPECT_FALSE(weak.expired());
+  EXPECT_EQ(memcmp(array.data(), "abc", 4), 0);
+  CArray array2 = array;
+  array = CArray();
+  EXPECT_FALSE(weak.expired());
+  array2 = CArray();
+  EXPECT_TRUE(weak.expired());
+}
@@ -2,6 +2,8 @@
 #include "../src/algorithm/basic.h"
 #include "constellation_commons.h"
 #include <iostream>
+#include <map>
+#include <set>
 
 using namespace constellation;
 class AlgoTest : public ::testing::Test {
@@ -73,3 +75,309 @@ TEST_F(AlgoTest, DijstraPathsAlgo2) {
   ASSERT_EQ(path_weights[3], 7);
   ASSERT_EQ(path_weights[4], 2);
 }
+
+TEST_F(AlgoTest, ScatterGroup) {
+  using namespace constellation::algorithm::basic;
+  // 9 -> {11, 13, 17}, 11 -> {15}
+  GlobalTransTopo transtopo;
+  transtopo[9].addChildren(11);
+  transtopo[9].addChildren(13);
+  transtopo[9].addChildren(17);
+  transtopo[11].setParent(9);
+  transtopo[11].addChildren(15);
+  transtopo[13].setParent(9);
+  transtopo[15].setParent(11);
+  transtopo[17].setParent(9);
+  // 13 is linked to both other children, 11 and 17 are not linked
+  AdjacencyList overlay = {{9, {11, 13, 17}},
+                           {11, {9, 13, 15}},
+                           {13, {9, 11, 17}},
+                           {15, {11}},
+                           {17, {9, 13}}};
+  auto group = set_scatter_group(transtopo, overlay);
+  ASSERT_EQ(group, std::vector<int>({9, 13, 11}));
+  EXPECT_EQ(transtopo[9].scatter_group, group);
+  EXPECT_EQ(transtopo[11].scatter_group, group);
+  EXPECT_TRUE(transtopo[15].scatter_group.empty());
+  EXPECT_TRUE(transtopo[17].scatter_group.empty());
+
+  // a link unfit for the group leaves its ends apart
+  group = set_scatter_group(transtopo, overlay, [](int u, int v) {
+    return !(std::min(u, v) == 11 && std::max(u, v) == 13);
+  });
+  ASSERT_EQ(group, std::vector<int>({9, 13, 17}));
+  EXPECT_TRUE(transtopo[11].scatter_group.empty());
+
+  // nothing to scatter without children
+  GlobalTransTopo single;
+  single[9] = NodeTransTopo();
+  single[9].setoRoot();
+  EXPECT_TRUE(set_scatter_group(single, {{9, {}}}).empty());
+}
+
+TEST_F(AlgoTest, PackSpanningTrees) {
+  using namespace constellation::algorithm::basic;
+  // the complete graph of 4 nodes holds 2 edge-disjoint spanning trees
+  AdjacencyList overlay = {{9, {10, 11, 12}},
+                           {10, {9, 11, 12}},
+                           {11, {9, 10, 12}},
+                           {12, {9, 10, 11}}};
+  AdjacencyListT<float> capacity;
+  for (const auto& [u, neighbors] : overlay) {
+    capacity[u].assign(neighbors.size(), 1.0f);
+  }
+  std::vector<float> bottlenecks;
+  auto trees = pack_spanning_trees(overlay, capacity, 5, &bottlenecks);
+  ASSERT_EQ(trees.size(), 2);
+  EXPECT_EQ(bottlenecks, std::vector<float>({1.0f, 1.0f}));
+  std::set<std::pair<int, int>> used;
+  for (const auto& tree : trees) {
+    ASSERT_EQ(tree.size(), 4);
+    int roots = 0;
+    for (const auto& [id, topo] : tree) {
+      if (topo.getType() == NodeTransTopo::Type::kRoot) {
+        roots++;
+        continue;
+      }
+      auto edge = std::minmax(id, topo.getParent());
+      EXPECT_TRUE(used.insert(edge).second) << "edge used twice";
+    }
+    EXPECT_EQ(roots, 1);
+  }
+
+  // a fat link is shared by the trees until its capacity is used up
+  overlay = {{9, {10}}, {10, {9, 11}}, {11, {10}}};
+  capacity = {{9, {3.0f}}, {10, {3.0f, 1.0f}}, {11, {1.0f}}};
+  trees = pack_spanning_trees(overlay, capacity, 5, &bottlenecks);
+  ASSERT_EQ(trees.size(), 1);
+  EXPECT_EQ(bottlenecks[0], 1.0f);
+  // rooted at the center
+  EXPECT_EQ(trees[0].at(10).getType(), NodeTransTopo::Type::kRoot);
+}
+
+TEST_F(AlgoTest, TakeTreeCapacity) {
+  using namespace constellation::algorithm::basic;
+  // a triangle, the tree 9 - 10 - 11 leaves the link 9 - 11 alone
+  AdjacencyList overlay = {{9, {10, 11}}, {10, {9, 11}}, {11, {9, 10}}};
+  AdjacencyListT<float> capacity = {
+      {9, {4.0f, 2.0f}}, {10, {4.0f, 3.0f}}, {11, {2.0f, 3.0f}}};
+  auto tree = pack_spanning_trees(overlay, {{9, {1.0f, 0.0f}},
+                                            {10, {1.0f, 1.0f}},
+                                            {11, {0.0f, 1.0f}}},
+                                  1);
+  ASSERT_EQ(tree.size(), 1);
+  AdjacencyListT<float> left;
+  EXPECT_EQ(take_tree_capacity(tree[0], overlay, capacity, &left), 3.0f);
+  EXPECT_EQ(left.at(9), std::vector<float>({1.0f, 2.0f}));
+  EXPECT_EQ(left.at(10), std::vector<float>({1.0f, 0.0f}));
+  EXPECT_EQ(left.at(11), std::vector<float>({2.0f, 0.0f}));
+  // what is left packs one more tree, over 9 - 10 and 9 - 11
+  std::vector<float> bottlenecks;
+  auto extra = pack_spanning_trees(overlay, left, 2, &bottlenecks);
+  ASSERT_EQ(extra.size(), 1);
+  EXPECT_EQ(bottlenecks[0], 1.0f);
+  EXPECT_EQ(extra[0].at(9).getType(), NodeTransTopo::Type::kRoot);
+
+  // a tree over a link outside the overlay
+  overlay = {{9, {10}}, {10, {9}}, {11, {}}};
+  EXPECT_THROW(
+      take_tree_capacity(tree[0], overlay, capacity), std::runtime_error);
+}
+
+TEST_F(AlgoTest, MaxBottleneckTree) {
+  using namespace constellation::algorithm::basic;
+  // a complete graph of 4 nodes, only the path 9 - 10 - 11 - 12 is fast
+  AdjacencyList overlay = {{9, {10, 11, 12}},
+                           {10, {9, 11, 12}},
+                           {11, {9, 10, 12}},
+                           {12, {9, 10, 11}}};
+  auto fast = [](int u, int v) { return std::abs(u - v) == 1; };
+  AdjacencyListT<float> bandwidth;
+  for (const auto& [u, neighbors] : overlay) {
+    for (int v : neighbors) {
+      bandwidth[u].push_back(fast(u, v) ? 1000.0f : 10.0f);
+    }
+  }
+  TreeCostModel model;
+  model.bytes = 1000000;
+  float bottleneck;
+  auto tree = max_bottleneck_tree(overlay, bandwidth, 0, 0, model, &bottleneck);
+  ASSERT_EQ(tree.size(), 4);
+  EXPECT_EQ(bottleneck, 1000.0f);
+  for (const auto& [id, topo] : tree) {
+    if (topo.getType() != NodeTransTopo::Type::kRoot) {
+      EXPECT_TRUE(fast(id, topo.getParent())) << id;
+    }
+  }
+  // rooted in the middle of the path, two hops up and two down
+  EXPECT_EQ(tree.at(10).getType(), NodeTransTopo::Type::kRoot);
+  EXPECT_DOUBLE_EQ(estimate_allreduce_time(tree, overlay, bandwidth, model),
+                   4 * model.bytes * 8 / 1e9);
+
+  // of depth 1 it is a star, which has to take slow links
+  tree = max_bottleneck_tree(overlay, bandwidth, 1, 0, model, &bottleneck);
+  ASSERT_EQ(tree.size(), 4);
+  EXPECT_EQ(bottleneck, 10.0f);
+  int root = 0;
+  for (const auto& [id, topo] : tree) {
+    if (topo.getType() == NodeTransTopo::Type::kRoot) {
+      root = id;
+    }
+  }
+  for (const auto& [id, topo] : tree) {
+    if (id != root) {
+      EXPECT_EQ(topo.getParent(), root);
+    }
+  }
+
+  // no path of 4 nodes has depth 2
+  EXPECT_TRUE(max_bottleneck_tree(overlay, bandwidth, 2, 1, model).empty());
+}
+
+TEST_F(AlgoTest, TreeCostModel) {
+  using namespace constellation::algorithm::basic;
+  // a root 9 of two children over 1000 Mbps edges
+  AdjacencyList overlay = {{9, {10, 11}}, {10, {9}}, {11, {9}}};
+  AdjacencyListT<float> bandwidth = {
+      {9, {1000.0f, 1000.0f}}, {10, {1000.0f}}, {11, {1000.0f}}};
+  GlobalTransTopo tree;
+  tree[9].setoRoot();
+  for (int child : {10, 11}) {
+    tree[child].setParent(9);
+    tree[9].addChildren(child);
+  }
+  TreeCostModel model;
+  model.bytes = 1000000;
+  const double send = 0.008;
+  // the children share the link of the root, both ways
+  EXPECT_DOUBLE_EQ(estimate_allreduce_time(tree, overlay, bandwidth, model),
+                   4 * send);
+  model.latency = 0.001;
+  model.reduce_rate = 1e9;
+  EXPECT_DOUBLE_EQ(estimate_allreduce_time(tree, overlay, bandwidth, model),
+                   (0.001 + 2 * send + 2 * 0.001) + (2 * send + 0.001));
+}
+
+TEST_F(AlgoTest, IncrementalTree) {
+  using namespace constellation::algorithm::basic;
+  // only 9 - 10, 10 - 11 and 11 - 12 are fast
+  AdjacencyList overlay = {{9, {10, 11, 12}},
+                           {10, {9, 11, 12}},
+                           {11, {9, 10, 12}},
+                           {12, {9, 10, 11}}};
+  auto fast = [](int u, int v) {
+    return std::minmax(u, v) == std::minmax(9, 10) ||
+           std::minmax(u, v) == std::minmax(10, 11) ||
+           std::minmax(u, v) == std::minmax(11, 12);
+  };
+  AdjacencyListT<float> bandwidth;
+  for (const auto& [u, neighbors] : overlay) {
+    for (int v : neighbors) {
+      bandwidth[u].push_back(fast(u, v) ? 1000.0f : 10.0f);
+    }
+  }
+  TreeCostModel model;
+  model.bytes = 1000000;
+  auto make_tree = [](const std::vector<std::pair<int, int>>& parents) {
+    GlobalTransTopo tree;
+    for (const auto& [v, p] : parents) {
+      if (p == 0) {
+        tree[v].setoRoot();
+      } else {
+        tree[v].setParent(p);
+        tree[p].addChildren(v);
+      }
+    }
+    return tree;
+  };
+  // 12 joins a tree rooted at 10, it is attached over its fast link and no
+  // other node moves
+  auto current = make_tree({{10, 0}, {9, 10}, {11, 10}});
+  int moves;
+  auto tree = incremental_tree(
+      current, overlay, bandwidth, model, 0, 0, 2, &moves);
+  ASSERT_EQ(tree.size(), 4);
+  EXPECT_EQ(moves, 0);
+  EXPECT_EQ(tree.at(12).getParent(), 11);
+  EXPECT_EQ(tree.at(9).getParent(), 10);
+  EXPECT_EQ(tree.at(11).getParent(), 10);
+
+  // 11 hangs off 9 over a slow link, one move fixes it, none if none is
+  // allowed
+  AdjacencyList small = {{9, {10, 11}}, {10, {9, 11}}, {11, {9, 10}}};
+  AdjacencyListT<float> small_bandwidth = {{9, {1000.0f, 10.0f}},
+                                           {10, {1000.0f, 1000.0f}},
+                                           {11, {10.0f, 1000.0f}}};
+  current = make_tree({{10, 0}, {9, 10}, {11, 9}});
+  tree = incremental_tree(
+      current, small, small_bandwidth, model, 0, 0, 1, &moves);
+  EXPECT_EQ(moves, 1);
+  EXPECT_EQ(tree.at(11).getParent(), 10);
+  tree = incremental_tree(
+      current, small, small_bandwidth, model, 0, 0, 0, &moves);
+  EXPECT_EQ(moves, 0);
+  EXPECT_EQ(tree.at(11).getParent(), 9);
+
+  // of fan-out 1 12 can only go under a leaf
+  current = make_tree({{10, 0}, {11, 10}, {9, 11}});
+  tree = incremental_tree(current, overlay, bandwidth, model, 0, 1, 0);
+  ASSERT_EQ(tree.size(), 4);
+  EXPECT_EQ(tree.at(12).getParent(), 9);
+
+  // a node that left, or no tree yet, needs a new tree
+  EXPECT_TRUE(incremental_tree(make_tree({{10, 0}, {13, 10}}),
+                               overlay,
+                               bandwidth,
+                               model,
+                               0,
+                               0,
+                               2)
+                  .empty());
+  EXPECT_TRUE(
+      incremental_tree({}, overlay, bandwidth, model, 0, 0, 2).empty());
+}
+
+TEST_F(AlgoTest, MaxFlowPaths) {
+  using namespace constellation::algorithm::basic;
+  // 12 joins next to 10 (100) and 11 (50), 9 only reaches it through 10 and
+  // 11. The cut around 12 allows 150
+  AdjacencyList overlay = {{9, {10, 11}},
+                           {10, {9, 11, 12}},
+                           {11, {9, 10, 12}},
+                           {12, {10, 11}}};
+  AdjacencyListT<float> capacity = {{9, {80.0f, 80.0f}},
+                                    {10, {80.0f, 20.0f, 100.0f}},
+                                    {11, {80.0f, 20.0f, 50.0f}},
+                                    {12, {100.0f, 50.0f}}};
+  std::vector<float> flows;
+  float max_flow;
+  auto paths = max_flow_paths(overlay, capacity, 12, &flows, &max_flow);
+  EXPECT_FLOAT_EQ(max_flow, 150.0f);
+  ASSERT_EQ(paths.size(), flows.size());
+  float sum = 0;
+  std::map<std::pair<int, int>, float> used;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const auto& path = paths[i].path;
+    ASSERT_GE(path.size(), 2);
+    EXPECT_NE(path.front(), 12);
+    EXPECT_EQ(path.back(), 12);
+    EXPECT_GT(flows[i], 0);
+    for (size_t j = 0; j + 1 < path.size(); ++j) {
+      used[{path[j], path[j + 1]}] += flows[i];
+    }
+    sum += flows[i];
+  }
+  EXPECT_FLOAT_EQ(sum, 150.0f);
+  // no edge carries more than its bandwidth
+  for (const auto& [edge, flow] : used) {
+    EXPECT_LE(flow, 100.0f + 1e-3) << edge.first << "->" << edge.second;
+  }
+  EXPECT_FLOAT_EQ((used[{10, 12}]), 100.0f);
+  EXPECT_FLOAT_EQ((used[{11, 12}]), 50.0f);
+
+  // a target nobody reaches gets no path
+  overlay = {{9, {}}, {12, {}}};
+  capacity = {{9, {}}, {12, {}}};
+  EXPECT_TRUE(max_flow_paths(overlay, capacity, 12, &flows, &max_flow).empty());
+  EXPECT_EQ(max_flow, 0.0f);
+}
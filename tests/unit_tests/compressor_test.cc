@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include "../src/compressor/compressor.h"
+#include "../src/compressor/powersgd_compressor.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace constellation;
+
+namespace {
+
+CArray MakeFloats(const std::vector<float>& values) {
+  CArray array(values.size() * sizeof(float),
+               static_cast<int>(ConstelDataType::CONSTEL_FLOAT32));
+  array.CopyFrom(values.data(), array.size());
+  return array;
+}
+
+std::vector<float> RandomFloats(size_t n, int seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> dis(0, 1);
+  std::vector<float> values(n);
+  for (auto& v : values) {
+    v = dis(gen);
+  }
+  return values;
+}
+
+std::vector<float> RoundTrip(Compressor* compressor,
+                             const std::vector<float>& values,
+                             size_t* compressed_size = nullptr) {
+  CArray compressed, decoded;
+  compressor->Compress(MakeFloats(values), &compressed);
+  if (compressed_size) {
+    *compressed_size = compressed.size();
+  }
+  EXPECT_EQ(Compressor::DecompressedSize(compressed),
+            values.size() * sizeof(float));
+  compressor->Decompress(compressed, &decoded);
+  auto* data = reinterpret_cast<float*>(decoded.data());
+  return std::vector<float>(data, data + values.size());
+}
+
+std::unique_ptr<Compressor> Create(const std::string& spec, bool ef = false) {
+  return CompressorFactory::CreateCompressor(spec, ef);
+}
+
+}  // namespace
+
+TEST(CompressorTest, Factory) {
+  EXPECT_EQ(Create(""), nullptr);
+  EXPECT_EQ(Create("none"), nullptr);
+  EXPECT_STREQ(Create("fp16")->name(), "fp16");
+  EXPECT_STREQ(Create("quantize:4")->name(), "quantize");
+  EXPECT_STREQ(Create("topk:0.1")->name(), "topk");
+  EXPECT_STREQ(Create("powersgd:2")->name(), "powersgd");
+  EXPECT_ANY_THROW(Create("zip"));
+}
+
+TEST(CompressorTest, FP16) {
+  std::vector<float> values = {0.0f, 1.0f, -2.5f, 0.333333f, 65504.0f};
+  size_t size;
+  auto decoded = RoundTrip(Create("fp16").get(), values, &size);
+  EXPECT_EQ(size, sizeof(Compressor::CompressedHeader) + values.size() * 2);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(decoded[i], values[i], std::fabs(values[i]) * 1e-3);
+  }
+}
+
+TEST(CompressorTest, Quantize) {
+  auto values = RandomFloats(1000, 1);
+  for (int bits : {8, 4}) {
+    auto compressor = Create("quantize:" + std::to_string(bits));
+    size_t size;
+    auto decoded = RoundTrip(compressor.get(), values, &size);
+    EXPECT_LT(size, values.size() * bits / 8 + 100);
+    float max_abs = 0;
+    for (auto v : values) {
+      max_abs = std::max(max_abs, std::fabs(v));
+    }
+    // off by at most one level
+    float unit = max_abs / ((1 << (bits - 1)) - 1);
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_LE(std::fabs(decoded[i] - values[i]), unit * 1.001f) << i;
+    }
+  }
+  // stochastic rounding is unbiased
+  auto compressor = Create("quantize:4");
+  std::vector<float> values2(256, 0.1f);
+  values2[0] = 1.0f;
+  double sum = 0;
+  const int rounds = 200;
+  for (int r = 0; r < rounds; ++r) {
+    sum += RoundTrip(compressor.get(), values2)[1];
+  }
+  EXPECT_NEAR(sum / rounds, 0.1, 0.01);
+}
+
+TEST(CompressorTest, TopK) {
+  std::vector<float> values = {0.1f, -5.0f, 0.2f, 3.0f, -0.3f, 0.0f, 1.0f, 0};
+  auto decoded = RoundTrip(Create("topk:0.25").get(), values);
+  std::vector<float> expected = {0, -5.0f, 0, 3.0f, 0, 0, 0, 0};
+  EXPECT_EQ(decoded, expected);
+}
+
+TEST(CompressorTest, PowerSGDExactForLowRank) {
+  size_t rows, cols;
+  PowerSGDCompressor::MatrixShape(1000, &rows, &cols);
+  EXPECT_EQ(rows, 32);
+  EXPECT_EQ(cols, 32);
+  // a rank one matrix is recovered exactly
+  std::vector<float> values(rows * cols);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t c = 0; c < cols; ++c) {
+      values[i * cols + c] = (i + 1.0f) * (c % 3 - 1.0f);
+    }
+  }
+  size_t size;
+  auto decoded = RoundTrip(Create("powersgd:1").get(), values, &size);
+  EXPECT_EQ(size, sizeof(Compressor::CompressedHeader) + 64 * sizeof(float));
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(decoded[i], values[i], 1e-3) << i;
+  }
+}
+
+TEST(CompressorTest, ErrorFeedback) {
+  // with error feedback the decoded values catch up with the sent ones, what
+  // is missing is the last residual; without it the small elements are lost
+  auto values = RandomFloats(100, 2);
+  for (bool ef : {true, false}) {
+    auto compressor = Create("topk:0.1", ef);
+    EXPECT_EQ(compressor->error_feedback(), ef);
+    std::vector<double> sent(values.size(), 0), received(values.size(), 0);
+    const int rounds = 100;
+    for (int r = 0; r < rounds; ++r) {
+      auto decoded = RoundTrip(compressor.get(), values);
+      for (size_t i = 0; i < values.size(); ++i) {
+        sent[i] += values[i];
+        received[i] += decoded[i];
+      }
+    }
+    double missing = 0, total = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+      missing += std::fabs(sent[i] - received[i]);
+      total += std::fabs(sent[i]);
+    }
+    if (ef) {
+      EXPECT_LT(missing / total, 0.1);
+    } else {
+      EXPECT_GT(missing / total, 0.5);
+    }
+  }
+}
@@ -151,3 +151,147 @@ TEST_F(ConstelAggEngineTest, PushTestConcurrent) {
 
   t.join();
 }
+
+TEST_F(ConstelAggEngineTest, ParallelForInsideHandle) {
+  // every engine thread is busy in a handle calling ParallelFor, the callers
+  // must finish the chunks themselves instead of waiting for a helper
+  std::vector<std::vector<int>> bufs(4, std::vector<int>(1000, 1));
+  engine->set_data_handle(
+      [this, &bufs](int id,
+                    int data,
+                    std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        auto& buf = bufs[id - 1];
+        engine->ParallelFor(10, [&buf, data](size_t i) {
+          for (size_t j = i * 100; j < (i + 1) * 100; ++j) {
+            buf[j] += data;
+          }
+        });
+        (*cb)(buf[0]);
+      });
+  engine->PushAndWait({1, 2, 3, 4}, {1, 2, 3, 4}, &res);
+  for (int id = 1; id <= 4; ++id) {
+    EXPECT_EQ(res[id], id + 1);
+    for (int v : bufs[id - 1]) {
+      EXPECT_EQ(v, id + 1);
+    }
+  }
+}
+
+TEST_F(ConstelAggEngineTest, StealFromBlockedThread) {
+  // keys 1 and 3 share a home thread; while key 1 blocks until key 3 is
+  // handled, key 3 can only make progress if the idle thread steals it
+  std::promise<void> key3_done;
+  auto key3_future = key3_done.get_future();
+  std::atomic<bool> stolen{false};
+  engine->set_data_handle(
+      [&](int id,
+          int data,
+          std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        if (id == 1) {
+          stolen = key3_future.wait_for(std::chrono::seconds(5)) ==
+                   std::future_status::ready;
+        } else if (id == 3) {
+          key3_done.set_value();
+        }
+        (*cb)(data);
+      });
+  engine->PushAndWait({1, 2, 3}, {10, 20, 30}, &res);
+  EXPECT_TRUE(stolen);
+  EXPECT_EQ(res[3], 30);
+}
+
+TEST_F(ConstelAggEngineTest, PerKeyOrder) {
+  std::vector<int> seen;
+  std::mutex mu;
+  engine->set_data_handle(
+      [&](int id,
+          int data,
+          std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          seen.push_back(data);
+        }
+        if (data == 99)
+          (*cb)(data);
+      });
+  for (int i = 0; i < 99; ++i) {
+    engine->PushAsync({1}, {i});
+  }
+  engine->PushAndWait({1}, {99}, &res);
+  ASSERT_EQ(seen.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(seen[i], i);
+  }
+}
+
+TEST_F(ConstelAggEngineTest, RebalanceByMeasuredCost) {
+  // keys 1 and 3 land on the same thread by count, but they are the slow ones
+  engine->set_data_handle(
+      [](int id,
+         int data,
+         std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        if (id % 2 == 1)
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        (*cb)(data);
+      });
+  engine->PushAndWait({1, 2, 3, 4}, {1, 2, 3, 4}, &res);
+  auto before = engine->GetLoadStats();
+  EXPECT_EQ(before.num_rebalances, 0);
+
+  EXPECT_GT(engine->Rebalance(), 0);
+  auto stats = engine->GetLoadStats();
+  EXPECT_EQ(stats.num_rebalances, 1);
+  EXPECT_NE(stats.key_to_thread[1], stats.key_to_thread[3]);
+
+  // nothing measured since, so the assignment stays
+  EXPECT_EQ(engine->Rebalance(), 0);
+  engine->PushAndWait({1, 2, 3, 4}, {1, 2, 3, 4}, &res);
+  EXPECT_EQ(res[3], 3);
+}
+
+TEST_F(ConstelAggEngineTest, RebalanceAfterEarlyReturn) {
+  // the slow keys are answered from another thread before their task is done,
+  // as a response may arrive before the task returns
+  engine->set_data_handle(
+      [](int id,
+         int data,
+         std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        std::thread([cb, data]() { (*cb)(data); }).join();
+        if (id % 2 == 1)
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      });
+  engine->PushAndWait({1, 2, 3, 4}, {1, 2, 3, 4}, &res);
+  EXPECT_GT(engine->Rebalance(), 0);
+  auto stats = engine->GetLoadStats();
+  EXPECT_NE(stats.key_to_thread[1], stats.key_to_thread[3]);
+}
+
+TEST(ConstelAggEnginePriorityTest, HigherPriorityFirst) {
+  constellation::ConstelAggEngine<int, int> engine(1);
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::vector<int> order;
+  engine.set_data_handle(
+      [&](int id,
+          int data,
+          std::shared_ptr<constellation::ReturnOnAgg<int, int>> cb) {
+        if (id == 0) {
+          released.wait();
+        } else {
+          order.push_back(id);
+        }
+        (*cb)(data);
+      });
+  engine.Start();
+  // key 0 keeps the only thread busy until all the others are queued
+  engine.PushAsync({0}, {0});
+  std::thread t([&release]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    release.set_value();
+  });
+  std::unordered_map<int, int> res;
+  engine.PushAndWait({1, 2, 3, 4}, {1, 2, 3, 4}, &res, {1, 3, 2, 1});
+  t.join();
+  engine.Stop();
+  EXPECT_EQ(order, std::vector<int>({2, 3, 1, 4}));
+}
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include "../src/trainer/fusion.h"
+
+#include <cstring>
+#include <random>
+
+using namespace constellation;
+
+class FusionTest : public ::testing::Test {
+ protected:
+  std::vector<CArray> MakeVals(const std::vector<size_t>& sizes,
+                               const std::vector<int>& dtypes = {}) {
+    std::vector<CArray> vals;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      vals.emplace_back(sizes[i], dtypes.empty() ? 0 : dtypes[i]);
+    }
+    return vals;
+  }
+};
+
+TEST_F(FusionTest, PackConsecutiveSmallKeys) {
+  std::vector<int> keys = {0, 1, 2, 3, 4};
+  auto vals = MakeVals({100, 200, 2000, 300, 400});
+  auto buckets = PlanFusionBuckets(keys, vals, 1024);
+  ASSERT_EQ(buckets.size(), 3);
+
+  EXPECT_TRUE(buckets[0].fused());
+  EXPECT_EQ(buckets[0].key, kFusionKeyBase + 0);
+  EXPECT_EQ(buckets[0].size, 300);
+  EXPECT_EQ(buckets[0].members, std::vector<size_t>({0, 1}));
+  EXPECT_EQ(buckets[0].offsets, std::vector<size_t>({0, 100}));
+
+  // the large key is passed through with its own key
+  EXPECT_FALSE(buckets[1].fused());
+  EXPECT_EQ(buckets[1].key, 2);
+  EXPECT_EQ(buckets[1].size, 2000);
+
+  EXPECT_EQ(buckets[2].key, kFusionKeyBase + 3);
+  EXPECT_EQ(buckets[2].offsets, std::vector<size_t>({0, 300}));
+}
+
+TEST_F(FusionTest, BucketLimitAndDtype) {
+  std::vector<int> keys = {5, 6, 7, 8};
+  auto vals = MakeVals({600, 600, 100, 100}, {0, 0, 0, 1});
+  auto buckets = PlanFusionBuckets(keys, vals, 1024);
+  // 600 + 600 exceeds the bucket, the dtype change also closes it
+  ASSERT_EQ(buckets.size(), 3);
+  EXPECT_EQ(buckets[0].key, 5);
+  EXPECT_EQ(buckets[1].key, kFusionKeyBase + 6);
+  EXPECT_EQ(buckets[1].members, std::vector<size_t>({1, 2}));
+  EXPECT_EQ(buckets[2].key, 8);
+  EXPECT_EQ(buckets[2].dtype, 1);
+}
+
+TEST_F(FusionTest, KeyChunks) {
+  // small keys are not split
+  auto whole = PlanKeyChunks(3, 1000, 0, 4096);
+  ASSERT_EQ(whole.size(), 1);
+  EXPECT_EQ(whole[0].key, 3);
+
+  auto chunks = PlanKeyChunks(3, 10000, 0, 4000);
+  // 4000 is rounded up to the cache line
+  ASSERT_EQ(chunks.size(), 3);
+  size_t total = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    EXPECT_EQ(chunks[i].key, kChunkKeyBase + 3 * kMaxKeyChunks + i);
+    EXPECT_EQ(chunks[i].offset, total);
+    EXPECT_EQ(chunks[i].offset % 64, 0);
+    total += chunks[i].size;
+  }
+  EXPECT_EQ(chunks[0].size, 4032);
+  EXPECT_EQ(total, 10000);
+
+  // the chunk size grows instead of exceeding kMaxKeyChunks
+  auto many = PlanKeyChunks(kMaxChunkedKey, 1 << 20, 0, 64);
+  EXPECT_LE(many.size(), kMaxKeyChunks);
+  EXPECT_GT(many.back().key, kChunkKeyBase);
+}
+
+TEST_F(FusionTest, ScatterSegments) {
+  // 100 cache lines over 3 members: 34, 33, 33
+  size_t size = 100 * 64 - 10;
+  size_t offset = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    auto seg = PlanScatterSegment(5, size, 0, 3, i);
+    EXPECT_EQ(seg.key, 5);
+    EXPECT_EQ(seg.offset, offset);
+    EXPECT_EQ(seg.offset % 64, 0);
+    offset += seg.size;
+  }
+  EXPECT_EQ(PlanScatterSegment(5, size, 0, 3, 0).size, 34 * 64);
+  EXPECT_EQ(offset, size);
+  // a small key leaves the last members without a segment
+  EXPECT_EQ(PlanScatterSegment(5, 100, 0, 3, 1).size, 100 - 64);
+  EXPECT_EQ(PlanScatterSegment(5, 100, 0, 3, 2).size, 0);
+}
+
+TEST_F(FusionTest, MigrateChunks) {
+  std::vector<int> keys = {4, 5, 6};
+  auto vals = MakeVals({100, 10000, 64});
+  // full keys, the large one in partial slices of the cache-aligned size
+  auto chunks = PlanMigrateChunks(KVSlice(4, 7), keys, vals, 4000);
+  ASSERT_EQ(chunks.size(), 5);
+  EXPECT_TRUE(chunks[0].is_full());
+  EXPECT_EQ(chunks[0].key_begin, 4);
+  uint64_t offset = 0;
+  for (size_t i = 1; i < 4; ++i) {
+    EXPECT_FALSE(chunks[i].is_full());
+    EXPECT_EQ(chunks[i].key_begin, 5);
+    EXPECT_EQ(chunks[i].slice, offset);
+    offset += chunks[i].slice_len;
+  }
+  EXPECT_EQ(chunks[1].slice_len, 4032);
+  EXPECT_EQ(offset, 10000);
+  EXPECT_TRUE(chunks[4].is_full());
+  EXPECT_EQ(chunks[4].key_begin, 6);
+
+  // a partial slice is split from its start
+  chunks = PlanMigrateChunks(KVSlice(5, 1000, 5000), keys, vals, 4032);
+  ASSERT_EQ(chunks.size(), 2);
+  EXPECT_EQ(chunks[0].slice, 1000);
+  EXPECT_EQ(chunks[0].slice_len, 4032);
+  EXPECT_EQ(chunks[1].slice, 5032);
+  EXPECT_EQ(chunks[1].slice_len, 968);
+
+  // no chunking, one message per key
+  chunks = PlanMigrateChunks(KVSlice(4, 7), keys, vals, 0);
+  ASSERT_EQ(chunks.size(), 3);
+  EXPECT_TRUE(chunks[1].is_full());
+  EXPECT_EQ(PlanMigrateChunks(KVSlice(5, 0, 10000), keys, vals, 0).size(), 1);
+}
+
+TEST_F(FusionTest, SnapshotMigrateValues) {
+  char raw[16] = "borrowed";
+  auto owner = std::make_shared<std::vector<char>>(32, 'x');
+  std::vector<CArray> vals = {CArray(raw, sizeof(raw), 1),
+                              CArray(owner, owner->data(), owner->size()),
+                              CArray(8)};
+  auto snapshot = SnapshotMigrateValues(vals);
+  ASSERT_EQ(snapshot.size(), 3);
+  // the borrowed buffer is copied, later writes do not reach the snapshot
+  EXPECT_NE(snapshot[0].data(), raw);
+  EXPECT_EQ(snapshot[0].size(), sizeof(raw));
+  EXPECT_EQ(snapshot[0].dtype, 1);
+  raw[0] = 'B';
+  EXPECT_EQ(snapshot[0].data()[0], 'b');
+  // the others are kept alive by sharing
+  EXPECT_EQ(snapshot[1].data(), owner->data());
+  EXPECT_EQ(snapshot[2].data(), vals[2].data());
+}
+
+TEST_F(FusionTest, MigrateDelta) {
+  const int kFloat = static_cast<int>(ConstelDataType::CONSTEL_FLOAT32);
+  std::mt19937 gen(7);
+  std::normal_distribution<float> dis(0, 1);
+  const size_t n = 1000;
+  CArray base(n * sizeof(float), kFloat), val(n * sizeof(float), kFloat);
+  auto* before = reinterpret_cast<float*>(base.data());
+  auto* after = reinterpret_cast<float*>(val.data());
+  for (size_t i = 0; i < n; ++i) {
+    before[i] = dis(gen);
+    // a few optimizer steps, some elements untouched
+    after[i] = i % 4 == 0 ? before[i] : before[i] - 1e-3f * dis(gen);
+  }
+  // the whole value and a partial slice
+  for (auto [offset, len] : {std::pair<size_t, size_t>{0, val.size()},
+                             std::pair<size_t, size_t>{64, 400}}) {
+    auto delta = EncodeMigrateDelta(val, base, offset, len);
+    // the regrouped XOR leaves out the bytes that did not change
+    EXPECT_LT(delta.size(), len * 9 / 10);
+    CArray got(base.size(), kFloat);
+    got.CopyFrom(base);
+    ApplyMigrateDelta(delta, got.data() + offset, len);
+    // the snapshot plus the delta is the value bit for bit
+    EXPECT_EQ(std::memcmp(got.data() + offset, val.data() + offset, len), 0);
+    EXPECT_EQ(std::memcmp(got.data(), base.data(), offset), 0);
+  }
+  // any dtype and length, nothing changed
+  const int kInt8 = static_cast<int>(ConstelDataType::CONSTEL_INT8);
+  CArray a(13, kInt8), b(13, kInt8);
+  std::memset(a.data(), 5, 13);
+  std::memset(b.data(), 5, 13);
+  b.data()[12] = 9;
+  auto delta = EncodeMigrateDelta(b, a, 0, 13);
+  ApplyMigrateDelta(delta, a.data(), 13);
+  EXPECT_EQ(std::memcmp(a.data(), b.data(), 13), 0);
+  delta = EncodeMigrateDelta(b, b, 0, 13);
+  ApplyMigrateDelta(delta, a.data(), 13);
+  EXPECT_EQ(std::memcmp(a.data(), b.data(), 13), 0);
+}
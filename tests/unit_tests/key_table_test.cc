@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "../src/utils/key_table.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using constellation::KeyTable;
+
+struct alignas(64) Counter {
+  std::atomic<int> value{0};
+};
+
+TEST(KeyTableTest, StableEntries) {
+  KeyTable<Counter> table;
+  EXPECT_EQ(table.Find(3), nullptr);
+  table.Reserve(8);
+  auto* entry = table.Get(3);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(table.Find(3), entry);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(entry) % 64, 0);
+  // sparse and virtual keys, e.g. fusion buckets and key chunks
+  const std::vector<int> keys = {1 << 30, (1 << 30) + (1 << 28) + 5, -1};
+  for (int key : keys) {
+    table.Get(key)->value = key;
+  }
+  for (int key : keys) {
+    EXPECT_EQ(table.Find(key)->value, key);
+  }
+  EXPECT_EQ(table.Get(3), entry);
+
+  std::vector<int> visited;
+  table.ForEach([&visited](int key, Counter*) { visited.push_back(key); });
+  EXPECT_EQ(visited.size(), 8 + keys.size());
+  EXPECT_EQ(visited[0], 0);
+  EXPECT_EQ(visited.back(), -1);
+}
+
+TEST(KeyTableTest, ConcurrentCreate) {
+  KeyTable<Counter> table;
+  const int num_threads = 4;
+  const int num_keys = 5000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&table]() {
+      for (int key = 0; key < num_keys; ++key) {
+        table.Get(key * 7)->value++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // every thread got the same entry of a key
+  for (int key = 0; key < num_keys; ++key) {
+    ASSERT_EQ(table.Find(key * 7)->value, num_threads);
+  }
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include "internal/CArray.h"
+#include "internal/memory_pool.h"
+
+#include <cstdint>
+#include <thread>
+
+using constellation::CArray;
+using constellation::MemoryPool;
+
+TEST(MemoryPoolTest, ClassSize) {
+  EXPECT_EQ(MemoryPool::ClassSize(1), 64);
+  EXPECT_EQ(MemoryPool::ClassSize(64), 64);
+  EXPECT_EQ(MemoryPool::ClassSize(65), 80);
+  EXPECT_EQ(MemoryPool::ClassSize(128), 128);
+  EXPECT_EQ(MemoryPool::ClassSize(129), 160);
+  EXPECT_EQ(MemoryPool::ClassSize(1000), 1024);
+  EXPECT_EQ(MemoryPool::ClassSize((1 << 20) + 1), (1 << 20) + (1 << 18));
+  // never more than a quarter wasted
+  for (size_t size = 65; size < (1 << 16); size += 37) {
+    EXPECT_GE(MemoryPool::ClassSize(size), size);
+    EXPECT_LE(MemoryPool::ClassSize(size), size + size / 4);
+  }
+}
+
+TEST(MemoryPoolTest, AlignedAndReused) {
+  auto* pool = MemoryPool::Get();
+  void* ptr = pool->Alloc(1000);
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % MemoryPool::kAlignment, 0);
+  pool->Free(ptr, 1000);
+
+  auto before = pool->GetStats();
+  // same size class, served from the cache
+  void* again = pool->Alloc(1010);
+  EXPECT_EQ(again, ptr);
+  auto after = pool->GetStats();
+  EXPECT_EQ(after.hits, before.hits + 1);
+  EXPECT_EQ(after.misses, before.misses);
+  pool->Free(again, 1010);
+
+  void* huge = pool->Alloc(MemoryPool::kHugePageSize);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(huge) % MemoryPool::kHugePageSize, 0);
+  pool->Free(huge, MemoryPool::kHugePageSize);
+  EXPECT_EQ(pool->Alloc(0), nullptr);
+}
+
+TEST(MemoryPoolTest, ReuseAcrossThreads) {
+  auto* pool = MemoryPool::Get();
+  const size_t size = 4 * MemoryPool::kMaxThreadCacheSize;
+  void* ptr = nullptr;
+  std::thread([&]() { ptr = pool->Alloc(size); }).join();
+  pool->Free(ptr, size);
+  // large buffers go to the shared list, any thread can reuse them
+  void* again = nullptr;
+  std::thread([&]() { again = pool->Alloc(size); }).join();
+  EXPECT_EQ(again, ptr);
+  pool->Free(again, size);
+
+  auto cached = pool->GetStats().bytes_cached;
+  pool->Trim();
+  EXPECT_LE(pool->GetStats().bytes_cached, cached - size);
+}
+
+TEST(MemoryPoolTest, CArrayUsesPool) {
+  auto* pool = MemoryPool::Get();
+  char* first;
+  {
+    CArray array(4096);
+    first = array.data();
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % MemoryPool::kAlignment, 0);
+  }
+  auto in_use = pool->GetStats().bytes_in_use;
+  CArray array(4096);
+  EXPECT_EQ(array.data(), first);
+  EXPECT_EQ(pool->GetStats().bytes_in_use, in_use + 4096);
+}
+
+TEST(MemoryPoolTest, CachedBytesLimit) {
+  auto* pool = MemoryPool::Get();
+  auto max_cached = pool->GetMaxCachedBytes();
+  pool->Trim();
+  auto base = pool->GetStats().bytes_cached;
+  const size_t size = 4 * MemoryPool::kMaxThreadCacheSize;
+  pool->SetMaxCachedBytes(base + size);
+  void* a = pool->Alloc(size);
+  void* b = pool->Alloc(size);
+  pool->Free(a, size);
+  // beyond the limit, back to the system
+  pool->Free(b, size);
+  EXPECT_EQ(pool->GetStats().bytes_cached, base + size);
+
+  // trim keeps what it is asked to
+  pool->SetMaxCachedBytes(0);
+  void* c = pool->Alloc(2 * size);
+  pool->Free(c, 2 * size);
+  EXPECT_EQ(pool->GetStats().bytes_cached, base + 3 * size);
+  pool->Trim(base + size);
+  EXPECT_EQ(pool->GetStats().bytes_cached, base + size);
+  pool->Trim();
+  EXPECT_EQ(pool->GetStats().bytes_cached, base);
+  pool->SetMaxCachedBytes(max_cached);
+}
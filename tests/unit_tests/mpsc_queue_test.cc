@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "../src/utils/mpsc_queue.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using constellation::MPSCQueue;
+
+TEST(MPSCQueueTest, MoveOnlyValues) {
+  MPSCQueue<std::unique_ptr<int>> queue(4);
+  EXPECT_EQ(queue.capacity(), 4);
+  EXPECT_TRUE(queue.Empty());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.TryPush(std::make_unique<int>(i)));
+  }
+  // full
+  auto extra = std::make_unique<int>(4);
+  EXPECT_FALSE(queue.TryPush(std::move(extra)));
+  ASSERT_NE(extra, nullptr);
+
+  std::unique_ptr<int> value;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(*value, i);
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(MPSCQueueTest, MultiProducerOrder) {
+  // a small ring makes the producers wait for free slots
+  MPSCQueue<std::pair<int, int>> queue(16);
+  const int num_producers = 4;
+  const int count = 20000;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_producers; ++p) {
+    producers.emplace_back([&queue, p]() {
+      for (int i = 0; i < count; ++i) {
+        queue.Push(std::make_pair(p, i));
+      }
+    });
+  }
+  // values of one producer come out in the order they were pushed
+  std::vector<int> next(num_producers, 0);
+  for (int n = 0; n < num_producers * count; ++n) {
+    std::pair<int, int> value;
+    queue.WaitAndPop(&value);
+    ASSERT_EQ(value.second, next[value.first]);
+    next[value.first]++;
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(MPSCQueueTest, WakeParkedConsumer) {
+  MPSCQueue<int> queue;
+  std::thread producer([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.Push(42);
+  });
+  int value = 0;
+  queue.WaitAndPop(&value);
+  EXPECT_EQ(value, 42);
+  producer.join();
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include "../src/trainer/reducer.h"
+#include "internal/CArray.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace constellation;
+using reducer::SimdLevel;
+
+class ReducerTest : public ::testing::TestWithParam<SimdLevel> {
+ protected:
+  void SetUp() override {
+    origin_ = reducer::GetSimdLevel();
+    if (!reducer::SetSimdLevel(GetParam())) {
+      GTEST_SKIP() << "CPU does not support "
+                   << reducer::SimdLevelName(GetParam());
+    }
+  }
+
+  void TearDown() override {
+    reducer::SetSimdLevel(origin_);
+  }
+
+  // odd lengths to cover both the vector body and the scalar tail
+  const std::vector<size_t> lens_ = {0, 1, 7, 8, 15, 16, 33, 1000, 4099};
+
+ private:
+  SimdLevel origin_;
+};
+
+template <typename T>
+void CheckSum(int dtype, size_t n) {
+  std::mt19937 gen(n);
+  std::uniform_int_distribution<int> dis(-1000, 1000);
+  std::vector<T> a(n), b(n), expected(n);
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = static_cast<T>(dis(gen)) / static_cast<T>(8);
+    b[i] = static_cast<T>(dis(gen)) / static_cast<T>(8);
+    expected[i] = a[i] + b[i];
+  }
+  reducer::Sum(a.data(), b.data(), n * sizeof(T), dtype);
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(a[i], expected[i]) << "index " << i << " of " << n;
+  }
+}
+
+TEST_P(ReducerTest, Float32) {
+  for (auto n : lens_) {
+    CheckSum<float>(static_cast<int>(ConstelDataType::CONSTEL_FLOAT32), n);
+  }
+}
+
+TEST_P(ReducerTest, Float64) {
+  for (auto n : lens_) {
+    CheckSum<double>(static_cast<int>(ConstelDataType::CONSTEL_FLOAT64), n);
+  }
+}
+
+TEST_P(ReducerTest, Int32) {
+  for (auto n : lens_) {
+    CheckSum<int32_t>(static_cast<int>(ConstelDataType::CONSTEL_INT32), n);
+  }
+}
+
+TEST_P(ReducerTest, Float16) {
+  // 1.5 + 2.25 = 3.75 and -0.5 + 0.125 = -0.375 are exact in half precision
+  const uint16_t a_vals[] = {0x3E00, 0xB800};
+  const uint16_t b_vals[] = {0x4080, 0x3000};
+  const uint16_t expected[] = {0x4380, 0xB600};
+  for (auto n : lens_) {
+    std::vector<uint16_t> a(n), b(n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = a_vals[i % 2];
+      b[i] = b_vals[i % 2];
+    }
+    reducer::Sum(a.data(),
+                 b.data(),
+                 n * sizeof(uint16_t),
+                 static_cast<int>(ConstelDataType::CONSTEL_FLOAT16));
+    for (size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(a[i], expected[i % 2]) << "index " << i << " of " << n;
+    }
+  }
+}
+
+TEST_P(ReducerTest, BFloat16) {
+  // 1.0 + 2.0 = 3.0 and 1.0 + 2^-8 rounds to even (1.0)
+  const uint16_t a_vals[] = {0x3F80, 0x3F80};
+  const uint16_t b_vals[] = {0x4000, 0x3B80};
+  const uint16_t expected[] = {0x4040, 0x3F80};
+  for (auto n : lens_) {
+    std::vector<uint16_t> a(n), b(n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = a_vals[i % 2];
+      b[i] = b_vals[i % 2];
+    }
+    reducer::Sum(a.data(),
+                 b.data(),
+                 n * sizeof(uint16_t),
+                 static_cast<int>(ConstelDataType::CONSTEL_BFLOAT16));
+    for (size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(a[i], expected[i % 2]) << "index " << i << " of " << n;
+    }
+  }
+}
+
+TEST_P(ReducerTest, ThreeOperands) {
+  size_t n = 1025;
+  std::vector<float> a(n, 1.0f), b(n, 2.0f), dst(n, 0.0f);
+  reducer::Sum(dst.data(),
+               a.data(),
+               b.data(),
+               n * sizeof(float),
+               static_cast<int>(ConstelDataType::CONSTEL_FLOAT32));
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(dst[i], 3.0f);
+    ASSERT_EQ(a[i], 1.0f);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllLevels,
+                         ReducerTest,
+                         ::testing::Values(SimdLevel::kScalar,
+                                           SimdLevel::kNeon,
+                                           SimdLevel::kAVX2,
+                                           SimdLevel::kAVX512));
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "../src/trainer/row_sparse.h"
+
+#include <vector>
+
+using namespace constellation;
+
+namespace {
+
+const int kFloat = static_cast<int>(ConstelDataType::CONSTEL_FLOAT32);
+
+CArray MakeRows(const std::vector<float>& values) {
+  CArray array(values.size() * sizeof(float), kFloat);
+  array.CopyFrom(values.data(), array.size());
+  return array;
+}
+
+std::vector<float> ToFloats(const CArray& array) {
+  auto* data = reinterpret_cast<const float*>(array.data());
+  return std::vector<float>(data, data + array.size() / sizeof(float));
+}
+
+}  // namespace
+
+TEST(RowSparseTest, PackSortsAndSumsDuplicates) {
+  // rows of two floats
+  auto packed = PackRowSparse({7, 2, 7}, MakeRows({1, 2, 3, 4, 10, 20}));
+  EXPECT_EQ(packed.size(),
+            sizeof(RowSparseHeader) + 2 * (sizeof(uint64_t) + 8));
+  std::vector<uint64_t> ids;
+  CArray rows;
+  UnpackRowSparse(packed, &ids, &rows);
+  EXPECT_EQ(ids, (std::vector<uint64_t>{2, 7}));
+  EXPECT_EQ(ToFloats(rows), (std::vector<float>{3, 4, 11, 22}));
+  EXPECT_EQ(rows.dtype, kFloat);
+}
+
+TEST(RowSparseTest, Empty) {
+  auto empty = PackRowSparse({}, MakeRows({}));
+  EXPECT_EQ(empty.size(), sizeof(RowSparseHeader));
+  std::vector<uint64_t> ids = {1};
+  CArray rows;
+  UnpackRowSparse(empty, &ids, &rows);
+  EXPECT_TRUE(ids.empty());
+  EXPECT_EQ(rows.size(), 0);
+  // merging with no rows keeps the other side
+  auto other = PackRowSparse({5}, MakeRows({1, 2, 3}));
+  EXPECT_EQ(MergeRowSparse(empty, other).data(), other.data());
+  EXPECT_EQ(MergeRowSparse(other, empty).data(), other.data());
+}
+
+TEST(RowSparseTest, Merge) {
+  auto a = PackRowSparse({1, 4, 9}, MakeRows({1, 4, 9}));
+  auto b = PackRowSparse({0, 4, 10, 9}, MakeRows({100, 40, 1000, 90}));
+  auto merged = MergeRowSparse(a, b);
+  std::vector<uint64_t> ids;
+  CArray rows;
+  UnpackRowSparse(merged, &ids, &rows);
+  EXPECT_EQ(ids, (std::vector<uint64_t>{0, 1, 4, 9, 10}));
+  EXPECT_EQ(ToFloats(rows), (std::vector<float>{100, 1, 44, 99, 1000}));
+  // the merge is a new buffer, the inputs are left alone
+  UnpackRowSparse(a, &ids, &rows);
+  EXPECT_EQ(ToFloats(rows), (std::vector<float>{1, 4, 9}));
+}
+
+TEST(RowSparseTest, UnpackSharesBuffer) {
+  CArray rows;
+  {
+    std::vector<uint64_t> ids;
+    auto packed = PackRowSparse({3}, MakeRows({5, 6}));
+    UnpackRowSparse(packed, &ids, &rows);
+    EXPECT_EQ(rows.data(),
+              packed.data() + sizeof(RowSparseHeader) + sizeof(uint64_t));
+  }
+  // still alive after the packed value is gone
+  EXPECT_EQ(ToFloats(rows), (std::vector<float>{5, 6}));
+}